@@ -0,0 +1,310 @@
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <future>
+#include <memory>
+#include <optional>
+
+#include "archive.h"
+#include "commit.h"
+#include "gzip_writer.h"
+#include "thread_pool.h"
+#include "tree.h"
+
+namespace {
+
+const size_t BLOCK = 512;
+// tar readers expect the archive to be a whole number of 20 block records
+const size_t RECORD = 20 * BLOCK;
+// sink calls are batched into writes of this size
+const size_t OUTPUT_BUFFER_SIZE = 64 * 1024;
+// blobs up to this size are inflated ahead of the writer; larger ones are
+// streamed by the writer itself when their turn comes
+const size_t PREFETCH_BLOB_LIMIT = 4 * 1024 * 1024;
+// total content of the blobs inflated ahead of the writer at any one time
+const size_t PREFETCH_BYTE_LIMIT = 64 * 1024 * 1024;
+
+// what a worker read for one blob; content is empty when the blob was too
+// large to prefetch and the writer streams it instead
+struct BlobRead {
+    size_t size;
+    std::optional<std::string> content;
+};
+
+// one file in the prefetch window. read is not valid when the pack entry
+// already showed the blob is too large; size then holds its size.
+struct PrefetchedBlob {
+    // bytes held against PREFETCH_BYTE_LIMIT until the writer takes the blob
+    size_t reserved;
+    size_t size;
+    std::future<BlobRead> read;
+};
+
+// Collects small header and padding writes and forwards them in large chunks.
+class BufferedOutput{
+    public:
+        explicit BufferedOutput(std::function<void(std::string_view)> sink): sink(std::move(sink))
+        {
+            buffer.reserve(OUTPUT_BUFFER_SIZE);
+        }
+
+        void write(std::string_view data)
+        {
+            written += data.size();
+            if (buffer.size() + data.size() > OUTPUT_BUFFER_SIZE)
+            {
+                flush();
+            }
+            if (data.size() >= OUTPUT_BUFFER_SIZE)
+            {
+                sink(data);
+                return;
+            }
+            buffer.append(data);
+        }
+
+        void flush()
+        {
+            if (!buffer.empty())
+            {
+                sink(buffer);
+                buffer.clear();
+            }
+        }
+
+        size_t bytesWritten() const { return written; }
+
+    private:
+        std::function<void(std::string_view)> sink;
+        std::string buffer;
+        size_t written = 0;
+};
+
+// "<size> 0 ustar fields", NUL terminated; false when value needs more digits
+bool putOctal(char* field, size_t width, uint64_t value)
+{
+    std::memset(field, '0', width - 1);
+    field[width - 1] = '\0';
+    for (size_t i = width - 1; i-- > 0 && value > 0; value >>= 3)
+    {
+        field[i] = static_cast<char>('0' + (value & 7));
+    }
+    return value == 0;
+}
+
+void putString(char* field, size_t width, std::string_view value)
+{
+    // an empty view may have a null data(), which memcpy must not be given
+    if (value.empty())
+    {
+        return;
+    }
+    std::memcpy(field, value.data(), std::min(value.size(), width));
+}
+
+// one pax "<length> <key>=<value>\n" record; the length counts itself
+std::string paxRecord(std::string_view key, std::string_view value)
+{
+    size_t length = key.size() + value.size() + 3;
+    size_t total = length + std::to_string(length).size();
+    if (std::to_string(total).size() != std::to_string(length).size())
+    {
+        total++;
+    }
+    return std::to_string(total) + ' ' + std::string(key) + '=' + std::string(value) + '\n';
+}
+
+void padToBlock(BufferedOutput& out, size_t size)
+{
+    static const char zeros[BLOCK] = {};
+    size_t remainder = size % BLOCK;
+    if (remainder != 0)
+    {
+        out.write(std::string_view(zeros, BLOCK - remainder));
+    }
+}
+
+void writeHeader(BufferedOutput& out,
+                 std::string_view path,
+                 unsigned mode,
+                 uint64_t size,
+                 char typeFlag,
+                 std::string_view linkTarget,
+                 time_t mtime)
+{
+    char header[BLOCK] = {};
+
+    // the name splits into prefix "/" name when it does not fit in 100 bytes
+    std::string_view name = path;
+    std::string_view prefix;
+    if (path.size() > 100)
+    {
+        size_t slash = path.find('/', path.size() - 101);
+        if (slash != std::string_view::npos && slash <= 155 && slash + 1 < path.size())
+        {
+            prefix = path.substr(0, slash);
+            name = path.substr(slash + 1);
+        }
+    }
+
+    putString(header, 100, name);
+    putOctal(header + 100, 8, mode);
+    putOctal(header + 108, 8, 0);
+    putOctal(header + 116, 8, 0);
+    bool sizeFits = putOctal(header + 124, 12, size);
+    putOctal(header + 136, 12, static_cast<uint64_t>(mtime));
+    header[156] = typeFlag;
+    putString(header + 157, 100, linkTarget);
+    std::memcpy(header + 257, "ustar\0" "00", 8);
+    putString(header + 265, 32, "root");
+    putString(header + 297, 32, "root");
+    putString(header + 345, 155, prefix);
+
+    // whatever the ustar fields cannot hold goes into a pax header first
+    std::string pax;
+    if (name.size() > 100 || prefix.size() > 155) pax += paxRecord("path", path);
+    if (linkTarget.size() > 100) pax += paxRecord("linkpath", linkTarget);
+    if (!sizeFits) pax += paxRecord("size", std::to_string(size));
+    if (!pax.empty())
+    {
+        writeHeader(out, "pax_header", 0644, pax.size(), 'x', "", mtime);
+        out.write(pax);
+        padToBlock(out, pax.size());
+    }
+
+    // checksum is computed with its own field filled with spaces
+    std::memset(header + 148, ' ', 8);
+    unsigned checksum = 0;
+    for (unsigned char c : header)
+    {
+        checksum += c;
+    }
+    putOctal(header + 148, 7, checksum);
+    out.write(std::string_view(header, BLOCK));
+}
+
+}
+
+void writeArchive(const Repository& repo,
+                  const std::string& treeish,
+                  const ArchiveOptions& options,
+                  const std::function<void(std::string_view)>& output)
+{
+    const ObjectDatabase& objects = repo.objects();
+    RawObject root = objects.readObject(treeish);
+    time_t mtime = root.type == ObjectType::commit ? parseCommitTime(root.content) : std::time(nullptr);
+
+    std::vector<TreeFile> files;
+    listTreeFiles(files, objects, repo.resolveTree(treeish));
+
+    ThreadPool pool(options.threadCount);
+    std::unique_ptr<ParallelGzipWriter> gzip;
+    std::function<void(std::string_view)> tarSink = output;
+    if (options.format == tarGzArchive)
+    {
+        gzip = std::make_unique<ParallelGzipWriter>(pool, output, options.compressionLevel);
+        tarSink = [&gzip](std::string_view data) { gzip->write(data); };
+    }
+    BufferedOutput out(tarSink);
+
+    // blobs inflated ahead of the writer, bounded by their total size; this
+    // window and the largest streamed chunk are what bound memory. Only sizes
+    // that cost no I/O decide anything here: a packed blob's entry header is
+    // read from the mapping, and a loose blob reserves the most a worker will
+    // hold for it until the worker reports its real size.
+    const size_t window = pool.size() * 2;
+    std::deque<PrefetchedBlob> prefetched;
+    size_t prefetchedBytes = 0;
+    size_t nextToPrefetch = 0;
+    auto prefetch = [&]()
+    {
+        while (nextToPrefetch < files.size() && prefetched.size() < window)
+        {
+            const TreeFile& file = files[nextToPrefetch];
+            ObjectId id;
+            std::optional<Header> packed;
+            if (parseObjectId(file.hash, id))
+            {
+                packed = objects.readPackedHeader(id);
+            }
+            // a symlink's target goes into its header, so it is always read whole
+            bool symlink = file.mode == "120000";
+            bool streamed = packed && packed->size > PREFETCH_BLOB_LIMIT && !symlink;
+            size_t reserved = streamed ? 0 : packed ? packed->size : PREFETCH_BLOB_LIMIT;
+            if (!prefetched.empty() && prefetchedBytes + reserved > PREFETCH_BYTE_LIMIT)
+            {
+                break;
+            }
+
+            PrefetchedBlob blob{reserved, packed ? packed->size : 0, {}};
+            if (!streamed)
+            {
+                blob.read = pool.submit([&objects, &file, symlink]
+                {
+                    if (symlink)
+                    {
+                        RawObject object = objects.readObject(file.hash);
+                        return BlobRead{object.content.size(), std::move(object.content)};
+                    }
+                    Header header(ObjectType::blob, 0);
+                    std::optional<RawObject> object = objects.readObjectIfSmall(file.hash, PREFETCH_BLOB_LIMIT, header);
+                    if (!object)
+                    {
+                        return BlobRead{header.size, std::nullopt};
+                    }
+                    return BlobRead{header.size, std::move(object->content)};
+                });
+            }
+            prefetched.push_back(std::move(blob));
+            prefetchedBytes += reserved;
+            nextToPrefetch++;
+        }
+    };
+
+    for (const TreeFile& file : files)
+    {
+        prefetch();
+        PrefetchedBlob blob = std::move(prefetched.front());
+        prefetched.pop_front();
+        BlobRead read = blob.read.valid() ? blob.read.get() : BlobRead{blob.size, std::nullopt};
+        unsigned mode = file.mode == "100755" ? 0755 : 0644;
+
+        if (!read.content)
+        {
+            prefetchedBytes -= blob.reserved;
+            writeHeader(out, file.path, mode, read.size, '0', "", mtime);
+            objects.streamObject(file.hash, [&out](std::string_view chunk)
+            {
+                out.write(chunk);
+            }, ObjectType::blob);
+            padToBlock(out, read.size);
+            continue;
+        }
+
+        const std::string& content = *read.content;
+        if (file.mode == "120000")
+        {
+            writeHeader(out, file.path, 0777, 0, '2', content, mtime);
+        }
+        else
+        {
+            writeHeader(out, file.path, mode, content.size(), '0', "", mtime);
+            out.write(content);
+            padToBlock(out, content.size());
+        }
+        prefetchedBytes -= blob.reserved;
+    }
+
+    // end of archive: two zero blocks, then pad the last record
+    static const char zeros[2 * BLOCK] = {};
+    out.write(std::string_view(zeros, sizeof(zeros)));
+    size_t remainder = out.bytesWritten() % RECORD;
+    std::string padding(remainder ? RECORD - remainder : 0, '\0');
+    out.write(padding);
+    out.flush();
+
+    if (gzip)
+    {
+        gzip->finish();
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <string_view>
+#include <zlib.h>
+
+#include "repository.h"
+
+enum ArchiveFormat {tarArchive, tarGzArchive};
+
+struct ArchiveOptions {
+    ArchiveFormat format = tarArchive;
+    int compressionLevel = Z_DEFAULT_COMPRESSION;
+    // 0 picks one worker per core
+    unsigned threadCount = 0;
+};
+
+// Write a tree (or a commit's tree) as a POSIX tar stream to output. Blobs
+// are inflated ahead of the writer on a worker pool, a bounded number of
+// bytes at a time, and written in path order as soon as each one is ready;
+// blobs too large to prefetch are streamed by the writer in chunks. With
+// tarGzArchive the stream is compressed in parallel blocks on the same pool.
+// Entries are stamped with the commit time, or the current time for a tree.
+void writeArchive(const Repository& repo,
+                  const std::string& treeish,
+                  const ArchiveOptions& options,
+                  const std::function<void(std::string_view)>& output);
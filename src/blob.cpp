@@ -1,87 +1,65 @@
-#include <sstream>
-#include <fstream>
-#include <filesystem>
+#include <cerrno>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "blob.h"
-#include "tree.h"
-#include "git_object.h"
 #include "helper.h"
 
-namespace fs = std::filesystem;
-
-void readBlobObject(std::string& output, const std::string& fileName)
+void readBlobObject(std::string& output, const ObjectDatabase& objects, const std::string& blobSha)
 {
-    GitObject blobObject(fileName);
-
-    if (blobObject.fileName.length() < 2)
+    RawObject blobObject = objects.readObject(blobSha);
+    if (blobObject.type != ObjectType::blob)
     {
-        throw std::runtime_error("git object name must be at least 2 characters long!");
+        throw std::runtime_error("object " + blobSha + " is not a blob");
     }
-    std::string decompressed;
-    zlibDecompression(decompressed, blobObject);
-    std::string_view decompressedView(decompressed);
+    output = std::move(blobObject.content);
+}
 
-    size_t nullPos = decompressedView.find('\0');
-    if (nullPos == std::string::npos)
+void streamBlobObject(int fd, const ObjectDatabase& objects, const std::string& blobSha)
+{
+    objects.streamObject(blobSha, [fd](std::string_view chunk)
     {
-        throw std::runtime_error("Missing null pointer between header and content");
-    }
-    blobObject.content = decompressedView.substr(nullPos+1);
-
-    std::string_view header = decompressedView.substr(0,nullPos);
-    size_t spacePos = header.find(' ');
-    blobObject.type = header.substr(0,spacePos);
-    blobObject.size = std::stol(std::string(header.substr(spacePos+1)));
-
-    output = std::string(blobObject.content);
+        if (!writeAllToFd(fd, chunk))
+        {
+            throw std::runtime_error("failed to write blob content");
+        }
+    }, ObjectType::blob);
 }
 
-void createBlobObject(std::string& hash, std::string inputFile)
+void createBlobObject(std::string& hash, ObjectDatabase& objects, const std::string& inputFile)
 {
-    // open file 
-    std::ifstream file(inputFile, std::ios::binary);
-    if(!file)
+    int fd = open(inputFile.c_str(), O_RDONLY);
+    if (fd < 0)
     {
         throw std::runtime_error("failed to open file " + inputFile);
     }
-    std::ostringstream oss;
-    oss << file.rdbuf();
-    std::string temp(oss.str());
-
-    // produce SHA-1 hash from the content + size + blob
-    std::string uncompressed("blob " + std::to_string(temp.size()) + '\0' + temp);
-    std::string hashStr;
-    getSHA1(hashStr, uncompressed);
-    std::string dirNamePart = hashStr.substr(0,2);
-    std::string fileNamePart = hashStr.substr(2);
-
-    // compress the  content + size + blob
-
-    // const size_t CHUNK_SIZE = 4096;
-    // std::vector<unsigned char> buffer(CHUNK_SIZE);
-    uLong uncompressedSize = uncompressed.size();
-    uLong compressedSize = compressBound(uncompressedSize);
-    std::vector<Bytef> compressed(compressedSize);
-    zlibCompression(compressed, compressedSize, uncompressedSize, uncompressed);
-
-    // create the SHA-1 file inside the sha1[:2] folder
-    fs::path folderPath(".git/objects/" + dirNamePart);
-    if(!fs::create_directories(folderPath))
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode))
     {
-        std::cerr << "failed to create directory " << folderPath.string();
+        close(fd);
+        // map the file and hand it to the writer as the only payload segment
+        MappedFile file(inputFile);
+        std::string_view content(reinterpret_cast<const char*>(file.data()), file.size());
+        hash = objects.writeObject(ObjectType::blob, content);
         return;
     }
-    std::string fileName(folderPath.string() + "/" + fileNamePart);
-    std::ofstream hashFile(fileName, std::ios::binary);
-    if (!hashFile.is_open())
+
+    // pipes and devices such as /dev/stdin have no size up front: read to the end
+    std::string content;
+    char buffer[64 * 1024];
+    ssize_t count;
+    while ((count = read(fd, buffer, sizeof(buffer))) != 0)
     {
-        std::cerr << "failed to create or open file " << fileName; 
-        return;
+        if (count < 0)
+        {
+            if (errno == EINTR) continue;
+            close(fd);
+            throw std::runtime_error("failed to read file " + inputFile);
+        }
+        content.append(buffer, static_cast<size_t>(count));
     }
-    // write the compressed file to it 
-    hashFile.write(reinterpret_cast<const char*>(compressed.data()), 
-                  compressedSize);
-    hashFile.close();
-    // print the file and folder name for verification for the tester
-    hash = hashStr;
-}
\ No newline at end of file
+    close(fd);
+    hash = objects.writeObject(ObjectType::blob, content);
+}
@@ -1,5 +1,9 @@
 #pragma once
 #include <string>
 
-void createBlobObject(std::string& hash, std::string inputFile);
-void readBlobObject(std::string& output, const std::string& fileName);
\ No newline at end of file
+#include "object_database.h"
+
+void createBlobObject(std::string& hash, ObjectDatabase& objects, const std::string& inputFile);
+void readBlobObject(std::string& output, const ObjectDatabase& objects, const std::string& blobSha);
+// write a blob's content to a file descriptor as it is inflated
+void streamBlobObject(int fd, const ObjectDatabase& objects, const std::string& blobSha);
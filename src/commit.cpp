@@ -1,6 +1,7 @@
 #include <chrono>
 #include <cstdlib>
 #include <ctime>
+#include <charconv>
 #include <iomanip>
 #include <sstream>
 #include <vector>
@@ -53,15 +54,17 @@ void Commit::serialize(std::string& output) const
     std::string authorSS;
     std::string committerSS;
     author.serialize(authorSS, "author");
-    committer.serialize(committerSS, "commit");
-    oss << authorSS << '\n';
-    oss << committerSS << '\n';
-    oss << message << '\n';
+    committer.serialize(committerSS, "committer");
+    // each header line ends in its own newline; one blank line precedes the message
+    oss << authorSS;
+    oss << committerSS;
+    oss << '\n' << message << '\n';
 
     output = oss.str();
 }
 
 void createCommit(std::string& commitSha,
+                  ObjectDatabase& objects,
                   std::string treeSha,
                   std::string parentSha,
                   std::string message)
@@ -78,37 +81,69 @@ void createCommit(std::string& commitSha,
 
     std::string commitContent;
     commit.serialize(commitContent);
-    size_t commitContentSize = commitContent.size();
-    Header header(ObjectType::commit, commitContentSize);
-    commit.header = header;
-
-    std::string wholeCommitContent(commit.header.typeAsString() + ' ');
-    wholeCommitContent += commit.header.size;
-    wholeCommitContent += '\0';
-    wholeCommitContent += commitContent;
-
-    // generate sha hash 
-    getSHA1(commitSha, wholeCommitContent);
-    std::string dirNamePart = commitSha.substr(0,2);
-    std::string fileNamePart = commitSha.substr(2);
-
-    // decompress  
-    uLong uncompressedSize = wholeCommitContent.size();
-    uLong compressedSize = compressBound(uncompressedSize);
-    std::vector<Bytef> compressed(compressedSize);
-    zlibCompression(compressed, compressedSize, 
-                        uncompressedSize, 
-                        wholeCommitContent);
-    
-
-    // and write to file 
-    bool status = writeToFile(dirNamePart, 
-                              fileNamePart,
-                              compressed, 
-                              compressedSize);
-    if(!status)
+    commit.header = Header(ObjectType::commit, commitContent.size());
+
+    // the header is formatted by ObjectWriter, so the size is decimal text
+    commitSha = objects.writeObject(commit.header.type, commitContent);
+}
+
+void parseCommitObject(const std::string& content,
+                       std::string& treeSha,
+                       std::vector<std::string>& parents)
+{
+    std::string_view remaining(content);
+    treeSha.clear();
+    parents.clear();
+
+    // headers run up to the first empty line
+    while (!remaining.empty())
+    {
+        size_t lineEnd = remaining.find('\n');
+        std::string_view line = remaining.substr(0, lineEnd);
+        if (line.empty()) break;
+
+        if (line.starts_with("tree "))
+        {
+            treeSha = line.substr(5);
+        }
+        else if (line.starts_with("parent "))
+        {
+            parents.emplace_back(line.substr(7));
+        }
+        if (lineEnd == std::string_view::npos) break;
+        remaining.remove_prefix(lineEnd + 1);
+    }
+
+    if (treeSha.empty())
     {
-        std::cerr << "failed to write compressed commit object";
-        return;
+        throw std::runtime_error("commit has no tree header");
     }
-}
\ No newline at end of file
+}
+
+time_t parseCommitTime(const std::string& content)
+{
+    std::string_view headers(content);
+    headers = headers.substr(0, headers.find("\n\n"));
+
+    for (std::string_view role : {"\ncommitter ", "\nauthor "})
+    {
+        size_t lineStart = headers.find(role);
+        if (lineStart == std::string_view::npos) continue;
+        std::string_view line = headers.substr(lineStart + 1);
+        line = line.substr(0, line.find('\n'));
+
+        // "<role> <name> <<email>> <timestamp> <timezone>"
+        size_t emailEnd = line.rfind('>');
+        if (emailEnd == std::string_view::npos) continue;
+        std::string_view rest = line.substr(emailEnd + 1);
+        while (!rest.empty() && rest.front() == ' ') rest.remove_prefix(1);
+
+        long long timestamp = 0;
+        auto [end, ec] = std::from_chars(rest.data(), rest.data() + rest.size(), timestamp);
+        if (ec == std::errc())
+        {
+            return static_cast<time_t>(timestamp);
+        }
+    }
+    return 0;
+}
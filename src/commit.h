@@ -1,6 +1,9 @@
 #pragma once
+#include <vector>
+
 #include "git_object.h"
 #include "helper.h"
+#include "object_database.h"
 
 
 struct User {
@@ -41,6 +44,15 @@ struct Commit {
 };
 
 void createCommit(std::string& commitSha,
+                  ObjectDatabase& objects,
                   std::string treeSha,
                   std::string parentSha,
-                  std::string message);
\ No newline at end of file
+                  std::string message);
+
+// read the "tree" and "parent" headers of a serialized commit body
+void parseCommitObject(const std::string& content,
+                       std::string& treeSha,
+                       std::vector<std::string>& parents);
+// committer timestamp of a serialized commit body (author when there is no
+// committer line), 0 when neither is present
+time_t parseCommitTime(const std::string& content);
@@ -0,0 +1,451 @@
+#include <cerrno>
+#include <fstream>
+#include <future>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <unordered_set>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "commit_graph.h"
+#include "commit.h"
+#include "thread_pool.h"
+#include "tree.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const size_t BITS_PER_PATH = 10;
+const size_t PROBE_COUNT = 7;
+const char GRAPH_MAGIC[4] = {'G', 'L', 'C', 'B'};
+const uint32_t GRAPH_VERSION = 1;
+// marks a saturated filter in place of its word count
+const uint32_t SATURATED_WORD_COUNT = 0xffffffffu;
+// commits whose filters are computed by one pool task
+const size_t FILTER_BATCH_SIZE = 32;
+
+// FNV-1a followed by a splitmix64 finalizer gives the two hashes that the
+// probes are derived from (probe i hits h1 + i * h2)
+void pathHashes(std::string_view path, uint64_t& h1, uint64_t& h2)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (unsigned char c : path)
+    {
+        hash ^= c;
+        hash *= 0x100000001b3ull;
+    }
+    h1 = hash;
+
+    hash += 0x9e3779b97f4a7c15ull;
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+    h2 = (hash ^ (hash >> 31)) | 1;
+}
+
+void writeBigEndian(std::string& out, uint64_t value, int bytes)
+{
+    for (int i = bytes - 1; i >= 0; i--)
+    {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+uint64_t readBigEndian(std::string_view& in, int bytes, const fs::path& file)
+{
+    if (in.size() < static_cast<size_t>(bytes))
+    {
+        throw std::runtime_error("truncated commit graph " + file.string());
+    }
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++)
+    {
+        value = (value << 8) | static_cast<unsigned char>(in[i]);
+    }
+    in.remove_prefix(bytes);
+    return value;
+}
+
+ObjectId readId(std::string_view& in, const fs::path& file)
+{
+    if (in.size() < 20)
+    {
+        throw std::runtime_error("truncated commit graph " + file.string());
+    }
+    ObjectId id;
+    std::copy(in.begin(), in.begin() + 20, id.begin());
+    in.remove_prefix(20);
+    return id;
+}
+
+ObjectId toObjectId(const std::string& sha)
+{
+    ObjectId id;
+    if (!parseObjectId(sha, id))
+    {
+        throw std::runtime_error("invalid object id " + sha);
+    }
+    return id;
+}
+
+// tree, parents and time straight from the commit object; no filter
+CommitGraphEntry readCommitEntry(const ObjectDatabase& objects, const ObjectId& id)
+{
+    RawObject object = objects.readObject(id);
+    if (object.type != ObjectType::commit)
+    {
+        throw std::runtime_error("object " + objectIdToHex(id) + " is not a commit");
+    }
+    std::string treeSha;
+    std::vector<std::string> parents;
+    parseCommitObject(object.content, treeSha, parents);
+
+    CommitGraphEntry entry;
+    entry.tree = toObjectId(treeSha);
+    for (const std::string& parent : parents)
+    {
+        entry.parents.push_back(toObjectId(parent));
+    }
+    entry.commitTime = parseCommitTime(object.content);
+    return entry;
+}
+
+std::string normalizePath(std::string_view path)
+{
+    while (path.starts_with("./")) path.remove_prefix(2);
+    while (path.ends_with("/")) path.remove_suffix(1);
+    return path == "." ? std::string() : std::string(path);
+}
+
+}
+
+BloomFilter::BloomFilter(const std::vector<std::string>& paths)
+{
+    if (paths.size() > MAX_PATHS)
+    {
+        saturated = true;
+        return;
+    }
+    size_t bitCount = std::max<size_t>(64, (paths.size() * BITS_PER_PATH + 63) / 64 * 64);
+    words.assign(bitCount / 64, 0);
+    for (const std::string& path : paths)
+    {
+        uint64_t h1, h2;
+        pathHashes(path, h1, h2);
+        for (size_t i = 0; i < PROBE_COUNT; i++)
+        {
+            uint64_t bit = (h1 + i * h2) % bitCount;
+            words[bit / 64] |= uint64_t(1) << (bit % 64);
+        }
+    }
+}
+
+bool BloomFilter::mightContain(std::string_view path) const
+{
+    // a default constructed filter has no bits and knows nothing
+    if (saturated || words.empty())
+    {
+        return true;
+    }
+    size_t bitCount = words.size() * 64;
+    uint64_t h1, h2;
+    pathHashes(path, h1, h2);
+    for (size_t i = 0; i < PROBE_COUNT; i++)
+    {
+        uint64_t bit = (h1 + i * h2) % bitCount;
+        if (!(words[bit / 64] & (uint64_t(1) << (bit % 64))))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+CommitGraph::CommitGraph(fs::path file): file(std::move(file))
+{
+    std::ifstream input(this->file, std::ios::binary);
+    if (!input)
+    {
+        return;
+    }
+    std::string data((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    std::string_view in(data);
+
+    // "GLCB" <version> <count>, then per commit:
+    // <id> <tree> <time:8> <parent count:4> <parents...> <word count:4> <words:8...>
+    if (in.size() < 4 || !std::equal(GRAPH_MAGIC, GRAPH_MAGIC + 4, in.begin()))
+    {
+        throw std::runtime_error("not a commit graph file " + this->file.string());
+    }
+    in.remove_prefix(4);
+    if (readBigEndian(in, 4, this->file) != GRAPH_VERSION)
+    {
+        throw std::runtime_error("unsupported commit graph version in " + this->file.string());
+    }
+    uint64_t count = readBigEndian(in, 4, this->file);
+    for (uint64_t i = 0; i < count; i++)
+    {
+        ObjectId id = readId(in, this->file);
+        CommitGraphEntry entry;
+        entry.tree = readId(in, this->file);
+        entry.commitTime = static_cast<time_t>(readBigEndian(in, 8, this->file));
+        uint64_t parentCount = readBigEndian(in, 4, this->file);
+        for (uint64_t p = 0; p < parentCount; p++)
+        {
+            entry.parents.push_back(readId(in, this->file));
+        }
+        uint64_t wordCount = readBigEndian(in, 4, this->file);
+        if (wordCount == SATURATED_WORD_COUNT)
+        {
+            entry.changedPaths.saturated = true;
+        }
+        else if (wordCount == 0)
+        {
+            // every filter written has at least one word; probing none would divide by zero
+            throw std::runtime_error("corrupt changed-path filter in " + this->file.string());
+        }
+        else
+        {
+            for (uint64_t w = 0; w < wordCount; w++)
+            {
+                entry.changedPaths.words.push_back(readBigEndian(in, 8, this->file));
+            }
+        }
+        entries.emplace(id, std::move(entry));
+    }
+}
+
+CommitGraph CommitGraph::empty(fs::path file)
+{
+    CommitGraph graph;
+    graph.file = std::move(file);
+    return graph;
+}
+
+fs::path CommitGraph::defaultPath(const ObjectDatabase& objects)
+{
+    return objects.directory() / "info" / "commit-bloom";
+}
+
+const CommitGraphEntry* CommitGraph::find(const ObjectId& id) const
+{
+    auto pos = entries.find(id);
+    return pos == entries.end() ? nullptr : &pos->second;
+}
+
+void CommitGraph::add(const ObjectId& id, CommitGraphEntry entry)
+{
+    entries.insert_or_assign(id, std::move(entry));
+}
+
+void CommitGraph::save() const
+{
+    std::string out(GRAPH_MAGIC, 4);
+    writeBigEndian(out, GRAPH_VERSION, 4);
+    writeBigEndian(out, entries.size(), 4);
+    for (const auto& [id, entry] : entries)
+    {
+        out.append(reinterpret_cast<const char*>(id.data()), id.size());
+        out.append(reinterpret_cast<const char*>(entry.tree.data()), entry.tree.size());
+        writeBigEndian(out, static_cast<uint64_t>(entry.commitTime), 8);
+        writeBigEndian(out, entry.parents.size(), 4);
+        for (const ObjectId& parent : entry.parents)
+        {
+            out.append(reinterpret_cast<const char*>(parent.data()), parent.size());
+        }
+        if (entry.changedPaths.saturated)
+        {
+            writeBigEndian(out, SATURATED_WORD_COUNT, 4);
+            continue;
+        }
+        writeBigEndian(out, entry.changedPaths.words.size(), 4);
+        for (uint64_t word : entry.changedPaths.words)
+        {
+            writeBigEndian(out, word, 8);
+        }
+    }
+
+    // write next to the target and rename so readers never see half a file;
+    // creating the lock exclusively keeps two concurrent writers apart
+    fs::create_directories(file.parent_path());
+    fs::path temporary(file.string() + ".lock");
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0444);
+    if (fd < 0)
+    {
+        if (errno == EEXIST)
+        {
+            throw std::runtime_error("unable to create " + temporary.string() +
+                                     ": another commit-graph write is running, or remove the stale lock");
+        }
+        throw std::runtime_error("failed to create " + temporary.string());
+    }
+    bool ok = writeAllToFd(fd, out);
+    ok = close(fd) == 0 && ok;
+    if (!ok || rename(temporary.c_str(), file.c_str()) != 0)
+    {
+        unlink(temporary.c_str());
+        throw std::runtime_error("failed to write " + file.string());
+    }
+}
+
+size_t writeCommitGraph(const Repository& repo,
+                        const std::vector<std::string>& tips,
+                        unsigned threadCount)
+{
+    const ObjectDatabase& objects = repo.objects();
+
+    // the file is a cache, so a damaged one is rebuilt from scratch and
+    // overwritten rather than failing every write until it is deleted
+    fs::path graphPath = CommitGraph::defaultPath(objects);
+    std::optional<CommitGraph> loaded;
+    try
+    {
+        loaded.emplace(graphPath);
+    } catch (const std::exception&)
+    {
+    }
+    CommitGraph graph = loaded ? std::move(*loaded) : CommitGraph::empty(graphPath);
+
+    // collect every commit the graph does not know yet; ancestors of an
+    // indexed commit were indexed along with it
+    std::map<ObjectId, CommitGraphEntry> newCommits;
+    std::vector<ObjectId> stack;
+    for (const std::string& tip : tips)
+    {
+        if (objects.readObject(tip).type == ObjectType::commit)
+        {
+            stack.push_back(toObjectId(tip));
+        }
+    }
+    while (!stack.empty())
+    {
+        ObjectId id = stack.back();
+        stack.pop_back();
+        if (graph.find(id) || newCommits.contains(id)) continue;
+
+        CommitGraphEntry entry = readCommitEntry(objects, id);
+        stack.insert(stack.end(), entry.parents.begin(), entry.parents.end());
+        newCommits.emplace(id, std::move(entry));
+    }
+
+    auto treeOf = [&](const ObjectId& id) -> std::string
+    {
+        if (const CommitGraphEntry* known = graph.find(id)) return objectIdToHex(known->tree);
+        return objectIdToHex(newCommits.at(id).tree);
+    };
+
+    std::vector<std::pair<const ObjectId*, CommitGraphEntry*>> work;
+    for (auto& [id, entry] : newCommits)
+    {
+        work.emplace_back(&id, &entry);
+    }
+
+    {
+        // the filters only read shared state, so each batch can diff on its own
+        ThreadPool pool(threadCount);
+        std::vector<std::future<void>> batches;
+        for (size_t start = 0; start < work.size(); start += FILTER_BATCH_SIZE)
+        {
+            size_t end = std::min(start + FILTER_BATCH_SIZE, work.size());
+            batches.push_back(pool.submit([&, start, end]
+            {
+                for (size_t i = start; i < end; i++)
+                {
+                    CommitGraphEntry& entry = *work[i].second;
+                    std::string parentTree = entry.parents.empty() ? std::string() : treeOf(entry.parents[0]);
+                    std::vector<std::string> paths;
+                    diffTreePaths(paths, objects, parentTree, objectIdToHex(entry.tree));
+                    entry.changedPaths = BloomFilter(paths);
+                }
+            }));
+        }
+        for (std::future<void>& batch : batches)
+        {
+            batch.get();
+        }
+    }
+
+    for (auto& [id, entry] : newCommits)
+    {
+        graph.add(id, std::move(entry));
+    }
+    graph.save();
+    return graph.size();
+}
+
+void walkHistory(const Repository& repo,
+                 const std::string& start,
+                 std::string_view path,
+                 const std::function<void(const std::string& commitSha)>& visit)
+{
+    const ObjectDatabase& objects = repo.objects();
+    std::string limitPath = normalizePath(path);
+
+    // the graph only speeds the walk up, so a damaged file is ignored and
+    // every commit is parsed and diffed instead
+    std::optional<CommitGraph> graph;
+    try
+    {
+        graph.emplace(CommitGraph::defaultPath(objects));
+    } catch (const std::exception&)
+    {
+    }
+
+    // commits outside the graph are parsed once and remembered
+    std::map<ObjectId, CommitGraphEntry> parsed;
+    auto entryOf = [&](const ObjectId& id) -> const CommitGraphEntry&
+    {
+        if (const CommitGraphEntry* known = graph ? graph->find(id) : nullptr) return *known;
+        auto pos = parsed.find(id);
+        if (pos == parsed.end())
+        {
+            pos = parsed.emplace(id, readCommitEntry(objects, id)).first;
+        }
+        return pos->second;
+    };
+
+    // newest first, ties broken by id so the order is stable
+    using QueueItem = std::pair<time_t, ObjectId>;
+    std::priority_queue<QueueItem> queue;
+    std::unordered_set<ObjectId, ObjectIdHash> seen;
+
+    ObjectId startId = toObjectId(start);
+    queue.emplace(entryOf(startId).commitTime, startId);
+    seen.insert(startId);
+
+    while (!queue.empty())
+    {
+        ObjectId id = queue.top().second;
+        queue.pop();
+        const CommitGraphEntry& entry = entryOf(id);
+
+        for (const ObjectId& parent : entry.parents)
+        {
+            if (seen.insert(parent).second)
+            {
+                queue.emplace(entryOf(parent).commitTime, parent);
+            }
+        }
+
+        bool include = true;
+        if (!limitPath.empty())
+        {
+            const CommitGraphEntry* indexed = graph ? graph->find(id) : nullptr;
+            if (indexed && !indexed->changedPaths.mightContain(limitPath))
+            {
+                include = false;
+            }
+            else
+            {
+                std::string parentTree = entry.parents.empty() ?
+                    std::string() : objectIdToHex(entryOf(entry.parents[0]).tree);
+                include = treePathChanged(objects, parentTree, objectIdToHex(entry.tree), limitPath);
+            }
+        }
+        if (include)
+        {
+            visit(objectIdToHex(id));
+        }
+    }
+}
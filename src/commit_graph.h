@@ -0,0 +1,78 @@
+#pragma once
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "object_index.h"
+#include "repository.h"
+
+// Fixed-size Bloom filter over the paths a commit changed: 10 bits per path
+// and 7 probes, so a path that was not changed answers "maybe" about 1% of
+// the time. Commits touching more than MAX_PATHS paths get a saturated filter
+// that always answers "maybe".
+class BloomFilter{
+    public:
+        static const size_t MAX_PATHS = 512;
+
+        BloomFilter() = default;
+        explicit BloomFilter(const std::vector<std::string>& paths);
+
+        bool mightContain(std::string_view path) const;
+
+        bool saturated = false;
+        std::vector<uint64_t> words;
+};
+
+struct CommitGraphEntry {
+    ObjectId tree;
+    std::vector<ObjectId> parents;
+    time_t commitTime = 0;
+    // paths changed relative to the first parent (or all paths for a root
+    // commit), with every directory containing a change
+    BloomFilter changedPaths;
+};
+
+// Per-commit tree, parents, time and changed-path filter, persisted in
+// `objects/info/commit-bloom` so history walks neither inflate commits nor
+// diff trees for commits whose filter rules a path out.
+class CommitGraph{
+    public:
+        // loads the file if it exists, otherwise starts empty
+        explicit CommitGraph(std::filesystem::path file);
+        // an empty graph that save() writes to file, ignoring what is there
+        static CommitGraph empty(std::filesystem::path file);
+
+        static std::filesystem::path defaultPath(const ObjectDatabase& objects);
+
+        const CommitGraphEntry* find(const ObjectId& id) const;
+        void add(const ObjectId& id, CommitGraphEntry entry);
+        size_t size() const { return entries.size(); }
+        void save() const;
+
+    private:
+        CommitGraph() = default;
+
+        std::filesystem::path file;
+        std::map<ObjectId, CommitGraphEntry> entries;
+};
+
+// index every commit reachable from tips that the graph does not know yet,
+// computing the changed-path filters on a pool of threadCount workers;
+// returns the number of commits in the saved graph
+size_t writeCommitGraph(const Repository& repo,
+                        const std::vector<std::string>& tips,
+                        unsigned threadCount = 0);
+
+// Visit commits reachable from start, newest commit time first. With a
+// non-empty path only commits whose tree differs from their first parent's
+// at that path (a file or a directory) are visited; the commit graph's
+// filters are consulted first and trees are only compared on "maybe".
+void walkHistory(const Repository& repo,
+                 const std::string& start,
+                 std::string_view path,
+                 const std::function<void(const std::string& commitSha)>& visit);
@@ -0,0 +1,344 @@
+#include <algorithm>
+#include <filesystem>
+#include <future>
+
+#include "fsck.h"
+#include "commit.h"
+#include "helper.h"
+#include "object_writer.h"
+#include "thread_pool.h"
+#include "tree.h"
+
+namespace {
+
+// where one copy of an object lives; pack is null for loose objects
+struct ObjectLocation {
+    ObjectId id;
+    const PackFile* pack;
+    uint64_t offset;
+};
+
+// an edge from one object to another, e.g. a tree entry or a commit parent
+struct Reference {
+    ObjectId from;
+    ObjectId target;
+    ObjectType expectedType;
+};
+
+struct CheckedObject {
+    ObjectId id;
+    ObjectType type;
+    bool corrupt;
+    std::string error;
+};
+
+struct BatchResult {
+    std::vector<CheckedObject> objects;
+    std::vector<Reference> references;
+};
+
+// objects handed to one pool task; large enough to amortize the queue
+const size_t BATCH_SIZE = 64;
+
+void addReference(std::vector<Reference>& references,
+                  const ObjectId& from,
+                  std::string_view targetSha,
+                  ObjectType expectedType)
+{
+    ObjectId target;
+    if (!parseObjectId(targetSha, target))
+    {
+        throw std::runtime_error("invalid object id " + std::string(targetSha));
+    }
+    references.push_back(Reference{from, target, expectedType});
+}
+
+void collectReferences(std::vector<Reference>& references,
+                       const ObjectId& id,
+                       ObjectType type,
+                       const std::string& content)
+{
+    if (type == ObjectType::tree)
+    {
+        Tree tree;
+        tree.parseTree(content);
+        for (const TreeEntries& entry : tree.entries)
+        {
+            // submodule commits live in another repository
+            if (entry.type == "commit") continue;
+            addReference(references, id, entry.hash,
+                         entry.type == "tree" ? ObjectType::tree : ObjectType::blob);
+        }
+    }
+    else if (type == ObjectType::commit)
+    {
+        std::string treeSha;
+        std::vector<std::string> parents;
+        parseCommitObject(content, treeSha, parents);
+        addReference(references, id, treeSha, ObjectType::tree);
+        for (const std::string& parent : parents)
+        {
+            addReference(references, id, parent, ObjectType::commit);
+        }
+    }
+    else if (type == ObjectType::tag)
+    {
+        // "object <sha>\ntype <type>\n..."
+        std::string_view view(content);
+        if (!view.starts_with("object ") || view.size() < 48 || view.substr(47, 6) != "\ntype ")
+        {
+            throw std::runtime_error("malformed tag header");
+        }
+        size_t typeEnd = view.find('\n', 53);
+        addReference(references, id, view.substr(7, 40),
+                     objectTypeFromString(view.substr(53, typeEnd - 53)));
+    }
+}
+
+void checkObject(BatchResult& result, const ObjectDatabase& objects, const ObjectLocation& location)
+{
+    CheckedObject checked{location.id, ObjectType::blob, false, ""};
+    try
+    {
+        std::string hash;
+        std::string content;
+        if (location.pack)
+        {
+            // packs carry no header text; the writer hashes one in front of the content
+            RawObject object = location.pack->readAt(location.offset,
+                [&objects](const ObjectId& baseId, unsigned depth)
+                {
+                    return objects.readDeltaBase(baseId, depth);
+                });
+            checked.type = object.type;
+            hash = ObjectWriter(object.type, {object.content}).sha();
+            content = std::move(object.content);
+        }
+        else
+        {
+            std::string data = objects.readLooseObjectData(location.id);
+            size_t nullPos = data.find('\0');
+            if (nullPos == std::string::npos)
+            {
+                throw std::runtime_error("missing null byte after header");
+            }
+            Header header = Header::parse(std::string_view(data).substr(0, nullPos));
+            checked.type = header.type;
+            if (header.size != data.size() - nullPos - 1)
+            {
+                throw std::runtime_error("header size " + std::to_string(header.size) +
+                                         " does not match content size " +
+                                         std::to_string(data.size() - nullPos - 1));
+            }
+            getSHA1(hash, data);
+            content = data.substr(nullPos + 1);
+        }
+
+        if (hash != objectIdToHex(location.id))
+        {
+            throw std::runtime_error("hash mismatch, content hashes to " + hash);
+        }
+        collectReferences(result.references, location.id, checked.type, content);
+    } catch (const std::exception& e)
+    {
+        checked.corrupt = true;
+        checked.error = e.what();
+    }
+    result.objects.push_back(std::move(checked));
+}
+
+std::string typeName(ObjectType type)
+{
+    return Header(type, 0).typeAsString();
+}
+
+// Open every pack under objects/pack. ObjectDatabase::packs() quietly leaves
+// out the ones that cannot be read, which are exactly what fsck must report,
+// so the directory is walked here and each failure becomes a corrupt line.
+std::vector<std::unique_ptr<PackFile>> openAllPacks(const std::filesystem::path& packDir,
+                                                    std::vector<std::string>& corrupt)
+{
+    namespace fs = std::filesystem;
+
+    std::vector<fs::path> paths;
+    std::error_code ec;
+    for (const fs::directory_entry& entry : fs::directory_iterator(packDir, ec))
+    {
+        paths.push_back(entry.path());
+    }
+    std::sort(paths.begin(), paths.end());
+
+    std::vector<std::unique_ptr<PackFile>> packs;
+    for (const fs::path& path : paths)
+    {
+        if (path.extension() == ".idx")
+        {
+            if (!fs::exists(fs::path(path).replace_extension(".pack"), ec))
+            {
+                corrupt.push_back(path.string() + ": index without a pack");
+            }
+            continue;
+        }
+        if (path.extension() != ".pack") continue;
+
+        if (!fs::exists(fs::path(path).replace_extension(".idx"), ec))
+        {
+            corrupt.push_back(path.string() + ": pack without an index");
+            continue;
+        }
+        try
+        {
+            packs.push_back(std::make_unique<PackFile>(path));
+        } catch (const std::exception& e)
+        {
+            corrupt.push_back(path.string() + ": " + e.what());
+        }
+    }
+    return packs;
+}
+
+}
+
+FsckReport checkObjects(const Repository& repo, unsigned threadCount)
+{
+    const ObjectDatabase& objects = repo.objects();
+
+    std::vector<std::string> packErrors;
+    std::vector<std::unique_ptr<PackFile>> packs = openAllPacks(objects.directory() / "pack", packErrors);
+
+    std::vector<ObjectLocation> locations;
+    for (const ObjectId& id : objects.listLooseObjects())
+    {
+        locations.push_back(ObjectLocation{id, nullptr, 0});
+    }
+    for (const std::unique_ptr<PackFile>& pack : packs)
+    {
+        const PackIndex& index = pack->index();
+        size_t first = locations.size();
+        for (size_t i = 0; i < index.count(); i++)
+        {
+            locations.push_back(ObjectLocation{index.id(i), pack.get(), index.offset(i)});
+        }
+        // deltas sit close to their bases, so walking each pack in offset
+        // order lets one batch reuse the bases it just resolved
+        std::sort(locations.begin() + first, locations.end(),
+                  [](const ObjectLocation& a, const ObjectLocation& b) { return a.offset < b.offset; });
+    }
+
+    std::vector<std::future<BatchResult>> batches;
+    {
+        ThreadPool pool(threadCount);
+        for (size_t start = 0; start < locations.size(); start += BATCH_SIZE)
+        {
+            size_t end = std::min(start + BATCH_SIZE, locations.size());
+            batches.push_back(pool.submit([&objects, &locations, start, end]
+            {
+                BatchResult result;
+                result.objects.reserve(end - start);
+                for (size_t i = start; i < end; i++)
+                {
+                    checkObject(result, objects, locations[i]);
+                }
+                return result;
+            }));
+        }
+    }
+
+    std::vector<CheckedObject> checked;
+    std::vector<Reference> references;
+    for (std::future<BatchResult>& batch : batches)
+    {
+        BatchResult result = batch.get();
+        checked.insert(checked.end(), std::make_move_iterator(result.objects.begin()),
+                       std::make_move_iterator(result.objects.end()));
+        references.insert(references.end(), result.references.begin(), result.references.end());
+    }
+
+    FsckReport report;
+    report.objectCount = checked.size();
+    report.corrupt = std::move(packErrors);
+
+    // an object stored both loose and packed is listed once per copy
+    std::sort(checked.begin(), checked.end(), [](const CheckedObject& a, const CheckedObject& b)
+    {
+        return a.id < b.id;
+    });
+    for (const CheckedObject& object : checked)
+    {
+        if (object.corrupt)
+        {
+            report.corrupt.push_back(objectIdToHex(object.id) + ": " + object.error);
+        }
+    }
+    auto findObject = [&checked](const ObjectId& id) -> const CheckedObject*
+    {
+        auto pos = std::lower_bound(checked.begin(), checked.end(), id,
+            [](const CheckedObject& object, const ObjectId& target) { return object.id < target; });
+        return pos != checked.end() && pos->id == id ? &*pos : nullptr;
+    };
+
+    std::sort(references.begin(), references.end(), [](const Reference& a, const Reference& b)
+    {
+        return a.target < b.target;
+    });
+    for (size_t i = 0; i < references.size(); i++)
+    {
+        const Reference& reference = references[i];
+        bool firstForTarget = i == 0 || references[i - 1].target != reference.target;
+        const CheckedObject* target = findObject(reference.target);
+        if (!target)
+        {
+            if (firstForTarget)
+            {
+                report.missing.push_back(typeName(reference.expectedType) + " " +
+                                         objectIdToHex(reference.target));
+            }
+        }
+        else if (!target->corrupt && target->type != reference.expectedType)
+        {
+            report.corrupt.push_back(objectIdToHex(reference.from) + ": references " +
+                                     objectIdToHex(reference.target) + " as a " +
+                                     typeName(reference.expectedType) + " but it is a " +
+                                     typeName(target->type));
+        }
+    }
+
+    std::vector<ObjectId> tips;
+    for (const std::string& sha : repo.listRefTargets())
+    {
+        ObjectId id;
+        parseObjectId(sha, id);
+        tips.push_back(id);
+    }
+    std::sort(tips.begin(), tips.end());
+    tips.erase(std::unique(tips.begin(), tips.end()), tips.end());
+
+    // a ref naming an object that is absent or broken leaves history unreachable
+    for (const ObjectId& tip : tips)
+    {
+        const CheckedObject* target = findObject(tip);
+        if (!target)
+        {
+            report.missing.push_back("ref " + objectIdToHex(tip));
+        }
+        else if (target->corrupt)
+        {
+            report.corrupt.push_back(objectIdToHex(tip) + ": a ref points to this corrupt object");
+        }
+    }
+
+    for (size_t i = 0; i < checked.size(); i++)
+    {
+        const CheckedObject& object = checked[i];
+        if (object.corrupt || (i > 0 && checked[i - 1].id == object.id)) continue;
+
+        auto referenced = std::lower_bound(references.begin(), references.end(), object.id,
+            [](const Reference& reference, const ObjectId& id) { return reference.target < id; });
+        bool isReferenced = referenced != references.end() && referenced->target == object.id;
+        if (!isReferenced && !std::binary_search(tips.begin(), tips.end(), object.id))
+        {
+            report.dangling.push_back(typeName(object.type) + " " + objectIdToHex(object.id));
+        }
+    }
+    return report;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "repository.h"
+
+struct FsckReport {
+    size_t objectCount = 0;
+    // "<sha>: <reason>" for objects that fail to inflate, rehash or parse,
+    // and "<path>: <reason>" for packs or pack indexes that cannot be opened
+    // or lack their partner file
+    std::vector<std::string> corrupt;
+    // "<type> <sha>" for objects referenced by a tree, commit or tag but
+    // absent, and "ref <sha>" for ref tips that name no object
+    std::vector<std::string> missing;
+    // "<type> <sha>" for objects nothing references and no ref points to
+    std::vector<std::string> dangling;
+
+    bool isClean() const { return corrupt.empty() && missing.empty(); }
+};
+
+// Verify every loose and packed object on a pool of threadCount workers
+// (0 picks one per core): each object is inflated and rehashed with
+// getSHA1, its header size is checked, and trees, commits and tags are
+// parsed so that the objects they reference can be checked for existence
+// and type once all workers are done.
+FsckReport checkObjects(const Repository& repo, unsigned threadCount = 0);
@@ -1,7 +1,11 @@
 // git_object.h
 #pragma once
+#include <charconv>
 #include <cstddef>
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
 struct GitObject{
     std::string dirName;
     std::string fileName;
@@ -16,7 +20,17 @@ struct GitObject{
     }
 };
 
-enum ObjectType {blob, commit, tree};
+enum ObjectType {blob, commit, tree, tag};
+
+inline ObjectType objectTypeFromString(std::string_view name)
+{
+    if (name == "blob") return ObjectType::blob;
+    if (name == "commit") return ObjectType::commit;
+    if (name == "tree") return ObjectType::tree;
+    if (name == "tag") return ObjectType::tag;
+    throw std::runtime_error("unknown object type " + std::string(name));
+}
+
 struct Header {
     ObjectType type;
     size_t size;
@@ -29,7 +43,28 @@ struct Header {
             case blob: return "blob";
             case commit: return "commit";
             case tree : return "tree";
+            case tag : return "tag";
             default: return "unknown";
         }
     }
-};
\ No newline at end of file
+
+    // parse "<type> <size>" (the part of an object before the null byte)
+    static Header parse(std::string_view header)
+    {
+        size_t spacePos = header.find(' ');
+        if (spacePos == std::string_view::npos)
+        {
+            throw std::runtime_error("malformed object header");
+        }
+        ObjectType type = objectTypeFromString(header.substr(0, spacePos));
+
+        std::string_view sizeText = header.substr(spacePos + 1);
+        size_t size = 0;
+        auto [end, ec] = std::from_chars(sizeText.data(), sizeText.data() + sizeText.size(), size);
+        if (ec != std::errc() || end != sizeText.data() + sizeText.size() || sizeText.empty())
+        {
+            throw std::runtime_error("malformed object size in header");
+        }
+        return Header(type, size);
+    }
+};
@@ -0,0 +1,180 @@
+#include <cstring>
+#include <deque>
+#include <future>
+#include <regex>
+
+#include "grep.h"
+#include "thread_pool.h"
+#include "tree.h"
+
+namespace {
+
+// how far into a blob to look for a NUL byte, same as Git's binary heuristic
+const size_t BINARY_CHECK_SIZE = 8000;
+
+struct BlobMatches {
+    std::string lines;
+    size_t count = 0;
+};
+
+bool isBinary(std::string_view content)
+{
+    return std::memchr(content.data(), '\0', std::min(content.size(), BINARY_CHECK_SIZE)) != nullptr;
+}
+
+// first occurrence of needle at or after from: memchr (vectorized in libc)
+// skips to candidates for the first byte and only those are compared in full
+size_t findLiteral(std::string_view haystack, std::string_view needle, size_t from)
+{
+    if (needle.empty())
+    {
+        return from <= haystack.size() ? from : std::string_view::npos;
+    }
+    const char* data = haystack.data();
+    while (from + needle.size() <= haystack.size())
+    {
+        size_t lastStart = haystack.size() - needle.size();
+        const void* hit = std::memchr(data + from, needle[0], lastStart - from + 1);
+        if (!hit)
+        {
+            return std::string_view::npos;
+        }
+        size_t pos = static_cast<const char*>(hit) - data;
+        if (data[pos + needle.size() - 1] == needle.back() &&
+            std::memcmp(data + pos + 1, needle.data() + 1, needle.size() - 1) == 0)
+        {
+            return pos;
+        }
+        from = pos + 1;
+    }
+    return std::string_view::npos;
+}
+
+void appendMatch(BlobMatches& matches,
+                 const std::string& path,
+                 const GrepOptions& options,
+                 size_t lineNumber,
+                 std::string_view line)
+{
+    matches.lines.append(path);
+    matches.lines.push_back(':');
+    if (options.lineNumbers)
+    {
+        matches.lines.append(std::to_string(lineNumber));
+        matches.lines.push_back(':');
+    }
+    matches.lines.append(line);
+    matches.lines.push_back('\n');
+    matches.count++;
+}
+
+BlobMatches searchBlob(const ObjectDatabase& objects,
+                       const TreeFile& file,
+                       const GrepOptions& options,
+                       const std::regex* pattern)
+{
+    BlobMatches matches;
+    RawObject blob = objects.readObject(file.hash);
+    std::string_view content(blob.content);
+    if (isBinary(content))
+    {
+        return matches;
+    }
+
+    size_t lineStart = 0;
+    size_t lineNumber = 1;
+    while (lineStart < content.size())
+    {
+        size_t lineEnd;
+        if (pattern)
+        {
+            lineEnd = content.find('\n', lineStart);
+            if (lineEnd == std::string_view::npos) lineEnd = content.size();
+            std::string_view line = content.substr(lineStart, lineEnd - lineStart);
+            if (std::regex_search(line.begin(), line.end(), *pattern))
+            {
+                appendMatch(matches, file.path, options, lineNumber, line);
+            }
+            lineNumber++;
+        }
+        else
+        {
+            // jump straight to the next hit instead of walking line by line
+            size_t hit = findLiteral(content, options.pattern, lineStart);
+            if (hit == std::string_view::npos) break;
+
+            const char* data = content.data();
+            for (const char* newline = static_cast<const char*>(std::memchr(data + lineStart, '\n', hit - lineStart));
+                 newline;
+                 newline = static_cast<const char*>(std::memchr(newline + 1, '\n', data + hit - newline - 1)))
+            {
+                lineStart = newline - data + 1;
+                lineNumber++;
+            }
+            lineEnd = content.find('\n', hit);
+            if (lineEnd == std::string_view::npos) lineEnd = content.size();
+            appendMatch(matches, file.path, options, lineNumber,
+                        content.substr(lineStart, lineEnd - lineStart));
+            lineNumber++;
+        }
+        lineStart = lineEnd + 1;
+    }
+    return matches;
+}
+
+}
+
+size_t grepTree(const Repository& repo,
+                const std::string& treeish,
+                const GrepOptions& options,
+                const std::function<void(std::string_view)>& output)
+{
+    const ObjectDatabase& objects = repo.objects();
+    std::vector<TreeFile> files;
+    listTreeFiles(files, objects, repo.resolveTree(treeish));
+
+    std::regex pattern;
+    if (options.regex)
+    {
+        pattern = std::regex(options.pattern);
+    }
+    const std::regex* patternPtr = options.regex ? &pattern : nullptr;
+
+    ThreadPool pool(options.threadCount);
+    // blobs in flight at once; results are emitted strictly in path order,
+    // so this bounds how much inflated content waits behind a slow blob
+    const size_t window = pool.size() * 4;
+    std::deque<std::future<BlobMatches>> pending;
+    size_t total = 0;
+
+    auto emitOldest = [&]()
+    {
+        BlobMatches matches = pending.front().get();
+        pending.pop_front();
+        total += matches.count;
+        if (!matches.lines.empty())
+        {
+            output(matches.lines);
+        }
+    };
+
+    for (const TreeFile& file : files)
+    {
+        // symlink targets are not file content
+        if (file.mode == "120000") continue;
+
+        pending.push_back(pool.submit([&objects, &file, &options, patternPtr]
+        {
+            return searchBlob(objects, file, options, patternPtr);
+        }));
+        if (pending.size() >= window)
+        {
+            emitOldest();
+        }
+    }
+    while (!pending.empty())
+    {
+        emitOldest();
+    }
+    return total;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <string_view>
+
+#include "repository.h"
+
+struct GrepOptions {
+    std::string pattern;
+    // treat pattern as an ECMAScript regular expression instead of a literal
+    bool regex = false;
+    bool lineNumbers = false;
+    // 0 picks one worker per core
+    unsigned threadCount = 0;
+};
+
+// Search every blob below a tree (or a commit's tree) for lines containing
+// the pattern. Blobs are inflated and scanned on a worker pool while the
+// matching lines, formatted as "<path>:[<line number>:]<line>\n", are
+// handed to output in path order. Blobs with a NUL byte in their first
+// 8000 bytes are treated as binary and skipped. Returns the number of
+// matching lines.
+size_t grepTree(const Repository& repo,
+                const std::string& treeish,
+                const GrepOptions& options,
+                const std::function<void(std::string_view)>& output);
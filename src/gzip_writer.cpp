@@ -0,0 +1,130 @@
+#include <stdexcept>
+#include <zlib.h>
+
+#include "gzip_writer.h"
+
+namespace {
+
+const size_t BLOCK_SIZE = 128 * 1024;
+const size_t DICTIONARY_SIZE = 32 * 1024;
+
+}
+
+ParallelGzipWriter::ParallelGzipWriter(ThreadPool& pool, Sink sink, int level):
+    pool(pool), sink(std::move(sink)), level(level), crc(crc32(0, Z_NULL, 0))
+{
+    // magic, deflate, no flags, no mtime, no extra flags, unknown OS
+    const char header[10] = {'\x1f', '\x8b', 8, 0, 0, 0, 0, 0, 0, '\x03'};
+    this->sink(std::string_view(header, sizeof(header)));
+    buffer.reserve(BLOCK_SIZE);
+}
+
+void ParallelGzipWriter::write(std::string_view data)
+{
+    while (!data.empty())
+    {
+        size_t take = std::min(data.size(), BLOCK_SIZE - buffer.size());
+        buffer.append(data.substr(0, take));
+        data.remove_prefix(take);
+        if (buffer.size() == BLOCK_SIZE)
+        {
+            submitBlock(false);
+        }
+    }
+}
+
+void ParallelGzipWriter::finish()
+{
+    if (finished)
+    {
+        return;
+    }
+    finished = true;
+    submitBlock(true);
+    while (!pending.empty())
+    {
+        emitOldest();
+    }
+
+    // CRC-32 and input size modulo 2^32, both little endian
+    char trailer[8];
+    for (int i = 0; i < 4; i++)
+    {
+        trailer[i] = static_cast<char>((crc >> (8 * i)) & 0xff);
+        trailer[4 + i] = static_cast<char>((totalSize >> (8 * i)) & 0xff);
+    }
+    sink(std::string_view(trailer, sizeof(trailer)));
+}
+
+void ParallelGzipWriter::submitBlock(bool last)
+{
+    std::string input = std::move(buffer);
+    std::string blockDictionary = dictionary;
+    if (input.size() >= DICTIONARY_SIZE)
+    {
+        dictionary = input.substr(input.size() - DICTIONARY_SIZE);
+    }
+    else
+    {
+        dictionary += input;
+        if (dictionary.size() > DICTIONARY_SIZE)
+        {
+            dictionary.erase(0, dictionary.size() - DICTIONARY_SIZE);
+        }
+    }
+    buffer.clear();
+    buffer.reserve(BLOCK_SIZE);
+
+    int blockLevel = level;
+    pending.push_back(pool.submit([input = std::move(input),
+                                   blockDictionary = std::move(blockDictionary),
+                                   blockLevel, last]
+    {
+        CompressedBlock block;
+        block.inputSize = input.size();
+        block.crc = crc32(0, reinterpret_cast<const Bytef*>(input.data()), input.size());
+
+        z_stream strm{};
+        // negative window bits: raw deflate, the gzip framing is written by hand
+        if (deflateInit2(&strm, blockLevel, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            throw std::runtime_error("deflateInit2 failed");
+        }
+        if (!blockDictionary.empty())
+        {
+            deflateSetDictionary(&strm, reinterpret_cast<const Bytef*>(blockDictionary.data()),
+                                 blockDictionary.size());
+        }
+
+        block.data.resize(deflateBound(&strm, input.size()) + 16);
+        strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+        strm.avail_in = input.size();
+        strm.next_out = reinterpret_cast<Bytef*>(block.data.data());
+        strm.avail_out = block.data.size();
+
+        int ret = deflate(&strm, last ? Z_FINISH : Z_SYNC_FLUSH);
+        bool complete = last ? ret == Z_STREAM_END : (ret == Z_OK && strm.avail_in == 0 && strm.avail_out != 0);
+        block.data.resize(block.data.size() - strm.avail_out);
+        deflateEnd(&strm);
+        if (!complete)
+        {
+            throw std::runtime_error("Unable to compress archive block using zlib");
+        }
+        return block;
+    }));
+
+    // keep a couple of blocks queued per worker, no more
+    if (pending.size() > pool.size() * 2)
+    {
+        emitOldest();
+    }
+}
+
+void ParallelGzipWriter::emitOldest()
+{
+    CompressedBlock block = pending.front().get();
+    pending.pop_front();
+    crc = crc32_combine(crc, block.crc, block.inputSize);
+    totalSize += block.inputSize;
+    sink(block.data);
+}
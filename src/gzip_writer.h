@@ -0,0 +1,46 @@
+#pragma once
+#include <deque>
+#include <functional>
+#include <future>
+#include <string>
+#include <string_view>
+
+#include "thread_pool.h"
+
+// gzip stream compressed in independent blocks on a thread pool, pigz style.
+// Each block is raw-deflated with the previous block's last 32 KiB as its
+// dictionary and ends on a byte boundary (Z_SYNC_FLUSH), so the compressed
+// blocks concatenate into one deflate stream; the CRCs are joined with
+// crc32_combine. Output reaches the sink in order, and at most a fixed
+// number of blocks are in flight at once.
+class ParallelGzipWriter{
+    public:
+        using Sink = std::function<void(std::string_view)>;
+
+        ParallelGzipWriter(ThreadPool& pool, Sink sink, int level);
+
+        void write(std::string_view data);
+        // compress what is left, terminate the stream and write the trailer
+        void finish();
+
+    private:
+        struct CompressedBlock {
+            std::string data;
+            unsigned long crc;
+            size_t inputSize;
+        };
+
+        void submitBlock(bool last);
+        void emitOldest();
+
+        ThreadPool& pool;
+        Sink sink;
+        int level;
+        std::string buffer;
+        // tail of the previous block, used as the next block's dictionary
+        std::string dictionary;
+        std::deque<std::future<CompressedBlock>> pending;
+        unsigned long crc;
+        unsigned long long totalSize = 0;
+        bool finished = false;
+};
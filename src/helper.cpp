@@ -1,3 +1,4 @@
+#include <cerrno>
 #include <iomanip>
 #include <sstream>
 #include <fstream>
@@ -41,101 +42,112 @@ void getSHA1(std::string& shaHash, std::string& data)
     byteToHexHash(shaHash, byteHash, SHA_DIGEST_LENGTH);
 }
 
-void zlibCompression(std::vector<Bytef>& compressed,
-                    uLong compressedSize, 
-                    uLong uncompressedSize,
-                    std::string uncompressedData)
+void zlibDecompression(std::string& decompressed, const fs::path& path)
 {
-
-    int ret = compress(compressed.data(), 
-                    &compressedSize, 
-                     reinterpret_cast<const Bytef*>(uncompressedData.data()), 
-                  uncompressedSize);
-    
-    if(ret != Z_OK)
+    decompressed.clear();
+    zlibDecompressionStream(path, [&decompressed](std::string_view chunk)
     {
-        std::cerr << "Unable to compress file using zlib";
-        return;
-    }
-    compressed.resize(compressedSize);
+        decompressed.append(chunk);
+    });
 }
 
-void zlibDecompression(std::string& decompressed, GitObject& object)
+namespace {
+
+// inflate a file chunk by chunk until the stream ends or sink returns false
+void inflateFile(const fs::path& path, const std::function<bool(std::string_view)>& sink)
 {
-    std::string path("./.git/objects/"+ object.dirName + "/" + object.fileName);
     std::ifstream file(path, std::ios::binary);
     if (!file)
     {
-        throw std::runtime_error("failed to open file " + path);
+        throw std::runtime_error("failed to open file " + path.string());
     }
-    // save file in memory for decompression 
-    std::vector<unsigned char> compressed(
-        (std::istreambuf_iterator<char>(file)),
-        std::istreambuf_iterator<char>()
-    );
 
-    // decompress the file using zlib
     z_stream strm{};
-    strm.next_in = compressed.data();
-    strm.avail_in = compressed.size();
-
     if(inflateInit(&strm) != Z_OK)
     {
         throw std::runtime_error("inflateInit failed");
     }
 
-    const size_t CHUNK_SIZE = 4096;
+    const size_t CHUNK_SIZE = 64 * 1024;
+    std::vector<unsigned char> input(CHUNK_SIZE);
     std::vector<unsigned char> buffer(CHUNK_SIZE);
-    std::vector<unsigned char> decompressedVector;
-
-    int ret;
-    do{
-        strm.next_out = buffer.data();
-        strm.avail_out = buffer.size();
 
-        ret = inflate(&strm, Z_NO_FLUSH);
-        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
-        {
-            inflateEnd(&strm);
-            throw std::runtime_error("Zlib inflate failed!");
-        }
-        decompressedVector.insert(decompressedVector.end(), 
-                            buffer.begin(),
-                            buffer.begin() + (buffer.size() - strm.avail_out)
-                            );
-    
-    } while (ret != Z_STREAM_END);
+    int ret = Z_OK;
+    try
+    {
+        do{
+            file.read(reinterpret_cast<char*>(input.data()), input.size());
+            std::streamsize readCount = file.gcount();
+            if (readCount == 0)
+            {
+                throw std::runtime_error("truncated zlib stream in " + path.string());
+            }
+            strm.next_in = input.data();
+            strm.avail_in = static_cast<uInt>(readCount);
+
+            // drain everything inflate can produce from this input chunk
+            do{
+                strm.next_out = buffer.data();
+                strm.avail_out = buffer.size();
+
+                ret = inflate(&strm, Z_NO_FLUSH);
+                if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+                {
+                    throw std::runtime_error("Zlib inflate failed!");
+                }
+                size_t produced = buffer.size() - strm.avail_out;
+                if (produced > 0 &&
+                    !sink(std::string_view(reinterpret_cast<const char*>(buffer.data()), produced)))
+                {
+                    inflateEnd(&strm);
+                    return;
+                }
+            } while (strm.avail_out == 0 && ret != Z_STREAM_END);
+
+        } while (ret != Z_STREAM_END);
+    } catch (...)
+    {
+        inflateEnd(&strm);
+        throw;
+    }
 
     inflateEnd(&strm);
+}
 
-    
-    decompressed = std::string(decompressedVector.begin(),decompressedVector.end());
 }
 
-bool writeToFile(std::string& dirNamePart, 
-                std::string& fileNamePart,
-                std::vector<Bytef>  compressed,
-                uLong compressedSize
-                )
+void zlibDecompressionStream(const fs::path& path,
+                            const std::function<void(std::string_view)>& sink)
 {
-    fs::path folderPath(".git/objects/" + dirNamePart);
-    if (!fs::create_directories(folderPath))
+    inflateFile(path, [&sink](std::string_view chunk)
     {
-        std::cerr << "failed to create directory " << folderPath.string();
-        return false;
-    }
-    std::string fileName(folderPath.string() + "/" + fileNamePart);
-    std::ofstream hashFile(fileName, std::ios::binary);
+        sink(chunk);
+        return true;
+    });
+}
 
-    if (!hashFile.is_open())
+std::string zlibDecompressionPrefix(const fs::path& path, size_t length)
+{
+    std::string prefix;
+    inflateFile(path, [&prefix, length](std::string_view chunk)
     {
-        std::cerr << "failed to create or open file " << fileName; 
-        return false;
-    }
+        prefix.append(chunk.substr(0, length - prefix.size()));
+        return prefix.size() < length;
+    });
+    return prefix;
+}
 
-    hashFile.write(reinterpret_cast<const char*>(compressed.data()), 
-                  compressedSize);
-    hashFile.close();
+bool writeAllToFd(int fd, std::string_view data)
+{
+    while (!data.empty())
+    {
+        ssize_t written = write(fd, data.data(), data.size());
+        if (written < 0)
+        {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data.remove_prefix(static_cast<size_t>(written));
+    }
     return true;
-
-}
\ No newline at end of file
+}
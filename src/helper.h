@@ -1,5 +1,8 @@
 #pragma once
+#include <filesystem>
+#include <functional>
 #include <iostream>
+#include <string_view>
 #include <unistd.h>
 #include <zlib.h>
 #include <vector>
@@ -9,13 +12,11 @@
 void byteToHexHash(std::string& hexHash, const unsigned char* byteHash, size_t len);
 void hexToByteHash(std::string& byteHash, std::string& hexHash);
 void getSHA1(std::string& shaHash, std::string& data);
-void zlibCompression(std::vector<Bytef>& compressed,
-                    uLong compressedSize, 
-                    uLong uncompressedSize,
-                    std::string uncompressedData);
-void zlibDecompression(std::string& decompressedView, GitObject& object);
-bool writeToFile(std::string& dirNamePart, 
-                std::string& fileNamePart,
-                std::vector<Bytef>  compressed,
-                uLong compressedSize
-                );
\ No newline at end of file
+void zlibDecompression(std::string& decompressed, const std::filesystem::path& path);
+// inflate a file chunk by chunk, handing each inflated chunk to sink;
+// memory use is bounded by the chunk size regardless of the object size
+void zlibDecompressionStream(const std::filesystem::path& path,
+                            const std::function<void(std::string_view)>& sink);
+// inflate only the first length bytes of a file (fewer if the stream ends)
+std::string zlibDecompressionPrefix(const std::filesystem::path& path, size_t length);
+bool writeAllToFd(int fd, std::string_view data);
@@ -1,3 +1,4 @@
+#include <charconv>
 #include <cstdlib>
 #include <exception>
 #include <fstream>
@@ -7,13 +8,29 @@
 #include <stdexcept>
 #include <string_view>
 #include <filesystem>
+#include <unistd.h>
 
-#include "blob.h"
-#include "commit.h"
-#include "tree.h"
+#include "archive.h"
+#include "commit_graph.h"
+#include "fsck.h"
+#include "grep.h"
+#include "helper.h"
+#include "repository.h"
 
 namespace fs = std::filesystem;
 
+namespace {
+
+// the value of a "--threads" option: a plain decimal count, 0 for one per core
+bool parseThreadCount(std::string_view text, unsigned& count)
+{
+    const char* end = text.data() + text.size();
+    auto [parsed, ec] = std::from_chars(text.data(), end, count);
+    return ec == std::errc() && parsed == end;
+}
+
+}
+
 
 
 
@@ -38,21 +55,9 @@ int main(int argc, char *argv[])
     
     if (command == "init") {
         try {
-            fs::create_directory(".git");
-            fs::create_directory(".git/objects");
-            fs::create_directory(".git/refs");
-    
-            std::ofstream headFile(".git/HEAD");
-            if (headFile.is_open()) {
-                headFile << "ref: refs/heads/main\n";
-                headFile.close();
-            } else {
-                std::cerr << "Failed to create .git/HEAD file.\n";
-                return EXIT_FAILURE;
-            }
-    
+            Repository::init(".");
             std::cout << "Initialized git directory\n";
-        } catch (const fs::filesystem_error& e) {
+        } catch (const std::exception& e) {
             std::cerr << e.what() << '\n';
             return EXIT_FAILURE;
         }
@@ -64,15 +69,14 @@ int main(int argc, char *argv[])
             std::cerr << "Blob filename error";
             return EXIT_FAILURE;
         }
-        std::string output;
         try 
         {
-            readBlobObject(output, argv[3]);
-            std::cout << output;
+            Repository repo = Repository::open(".");
+            repo.streamBlob(argv[3], STDOUT_FILENO);
 
         } catch (const std::exception& e)
         {
-            std::cerr << e.what() << "/n";
+            std::cerr << e.what() << "\n";
             return EXIT_FAILURE;
         }
 
@@ -88,9 +92,15 @@ int main(int argc, char *argv[])
         {
             std::cerr << "missing paramter: -w <fileName>\n";
         }
-        std::string hash;
-        createBlobObject(hash, argv[3]);
-        std::cout << hash;
+        try
+        {
+            Repository repo = Repository::open(".");
+            std::cout << repo.hashFile(argv[3]);
+        } catch (const std::exception& e)
+        {
+            std::cerr << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
 
     }
 
@@ -99,11 +109,20 @@ int main(int argc, char *argv[])
         if (argc !=4 || std::string(argv[2]) !="--name-only")
         {
             std::cerr << "wrong paramter usage --name-only <tree_sha>";
-            std::cerr << argc;
-            std::cerr << "argv[2]" << argv[2];
             return EXIT_FAILURE;
         }
-        readTreeObject(argv[3]);
+        try
+        {
+            Repository repo = Repository::open(".");
+            for (const TreeEntries& entry : repo.readTree(argv[3]).entries)
+            {
+                std::cout << entry.name << "\n";
+            }
+        } catch (const std::exception& e)
+        {
+            std::cerr << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
 
     }
     else if (command == "write-tree")
@@ -112,9 +131,15 @@ int main(int argc, char *argv[])
         {
             std::cerr << "no argument expected";
         }
-        std::string treeHash;
-        writeTreeObject(treeHash);
-        std::cout << treeHash;
+        try
+        {
+            Repository repo = Repository::open(".");
+            std::cout << repo.writeTree();
+        } catch (const std::exception& e)
+        {
+            std::cerr << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
     }
     else if (command == "commit-tree")
     {
@@ -134,12 +159,185 @@ int main(int argc, char *argv[])
             std::cerr << "message needed for the commit";
             return EXIT_FAILURE;
         }
-        std::string commitSha;
-        createCommit(commitSha, std::string(argv[2]), 
-             std::string(argv[4]), std::string(argv[6]));
-        std::cout << commitSha;
+        try
+        {
+            Repository repo = Repository::open(".");
+            std::cout << repo.createCommit(argv[2], argv[4], argv[6]);
+        } catch (const std::exception& e)
+        {
+            std::cerr << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
 
     }
+    else if (command == "fsck")
+    {
+        unsigned threadCount = 0;
+        bool validThreads = argc == 4 && std::string(argv[2]) == "--threads" &&
+                            parseThreadCount(argv[3], threadCount);
+        if (argc != 2 && !validThreads)
+        {
+            std::cerr << "Usage: ./your_program.sh fsck [--threads <count>]";
+            return EXIT_FAILURE;
+        }
+        try
+        {
+            Repository repo = Repository::open(".");
+            FsckReport report = checkObjects(repo, threadCount);
+            for (const std::string& line : report.corrupt) std::cout << "corrupt " << line << "\n";
+            for (const std::string& line : report.missing) std::cout << "missing " << line << "\n";
+            for (const std::string& line : report.dangling) std::cout << "dangling " << line << "\n";
+            std::cerr << "checked " << report.objectCount << " objects\n";
+            if (!report.isClean())
+            {
+                return EXIT_FAILURE;
+            }
+        } catch (const std::exception& e)
+        {
+            std::cerr << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+    else if (command == "grep")
+    {
+        GrepOptions options;
+        bool validThreads = true;
+        int argIndex = 2;
+        for (; argIndex < argc - 2; argIndex++)
+        {
+            std::string flag = argv[argIndex];
+            if (flag == "-E") options.regex = true;
+            else if (flag == "-n") options.lineNumbers = true;
+            else if (flag == "--threads" && argIndex + 1 < argc - 2)
+            {
+                validThreads = parseThreadCount(argv[++argIndex], options.threadCount);
+                if (!validThreads) break;
+            }
+            else break;
+        }
+        if (!validThreads || argc - argIndex != 2)
+        {
+            std::cerr << "Usage: ./your_program.sh grep [-E] [-n] [--threads <count>] <pattern> <tree_sha>";
+            return EXIT_FAILURE;
+        }
+        options.pattern = argv[argIndex];
+        try
+        {
+            Repository repo = Repository::open(".");
+            size_t matches = grepTree(repo, argv[argIndex + 1], options, [](std::string_view lines)
+            {
+                writeAllToFd(STDOUT_FILENO, lines);
+            });
+            if (matches == 0)
+            {
+                return EXIT_FAILURE;
+            }
+        } catch (const std::exception& e)
+        {
+            std::cerr << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+    else if (command == "commit-graph")
+    {
+        if (argc < 3 || std::string(argv[2]) != "write")
+        {
+            std::cerr << "Usage: ./your_program.sh commit-graph write [<commit_sha>...]";
+            return EXIT_FAILURE;
+        }
+        try
+        {
+            Repository repo = Repository::open(".");
+            std::vector<std::string> tips(argv + 3, argv + argc);
+            if (tips.empty())
+            {
+                tips = repo.listRefTargets();
+            }
+            size_t commitCount = writeCommitGraph(repo, tips);
+            std::cout << "indexed " << commitCount << " commits\n";
+        } catch (const std::exception& e)
+        {
+            std::cerr << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+    else if (command == "rev-list" || command == "log")
+    {
+        std::string path;
+        if (argc == 5 && std::string(argv[3]) == "--")
+        {
+            path = argv[4];
+        }
+        else if (argc != 3)
+        {
+            std::cerr << "Usage: ./your_program.sh " << command << " <commit_sha> [-- <path>]";
+            return EXIT_FAILURE;
+        }
+        try
+        {
+            Repository repo = Repository::open(".");
+            bool isLog = command == "log";
+            walkHistory(repo, argv[2], path, [&repo, isLog](const std::string& commitSha)
+            {
+                std::string entry = isLog ? "commit " + commitSha + "\n" : commitSha + "\n";
+                if (isLog)
+                {
+                    // the message follows the first empty line
+                    std::string content = repo.readObject(commitSha).content;
+                    size_t bodyStart = content.find("\n\n");
+                    std::string_view body = bodyStart == std::string::npos ?
+                        std::string_view() : std::string_view(content).substr(bodyStart + 2);
+                    entry += "\n";
+                    while (!body.empty())
+                    {
+                        size_t lineEnd = body.find('\n');
+                        entry += "    " + std::string(body.substr(0, lineEnd)) + "\n";
+                        if (lineEnd == std::string_view::npos) break;
+                        body.remove_prefix(lineEnd + 1);
+                    }
+                    entry += "\n";
+                }
+                writeAllToFd(STDOUT_FILENO, entry);
+            });
+        } catch (const std::exception& e)
+        {
+            std::cerr << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+    else if (command == "archive")
+    {
+        ArchiveOptions options;
+        std::string format = "--format=tar";
+        if (argc == 4)
+        {
+            format = argv[2];
+        }
+        if ((argc != 3 && argc != 4) || (format != "--format=tar" && format != "--format=tar.gz"))
+        {
+            std::cerr << "Usage: ./your_program.sh archive [--format=tar|tar.gz] <tree_sha>";
+            return EXIT_FAILURE;
+        }
+        if (format == "--format=tar.gz")
+        {
+            options.format = tarGzArchive;
+        }
+        try
+        {
+            Repository repo = Repository::open(".");
+            writeArchive(repo, argv[argc - 1], options, [](std::string_view data)
+            {
+                if (!writeAllToFd(STDOUT_FILENO, data))
+                {
+                    throw std::runtime_error("failed to write archive");
+                }
+            });
+        } catch (const std::exception& e)
+        {
+            std::cerr << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
     else{
         std::cerr << "Unknown command " << command << '\n';
         return EXIT_FAILURE;
@@ -0,0 +1,345 @@
+#include <stdexcept>
+
+#include "object_database.h"
+#include "helper.h"
+#include "object_writer.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// an object header is at most "commit <20 digits>" plus its null byte, so
+// only this much is ever inflated or buffered to find it
+const size_t MAX_HEADER_SIZE = 32;
+
+void checkObjectType(const std::string& sha, const Header& header, std::optional<ObjectType> expectedType)
+{
+    if (expectedType && header.type != *expectedType)
+    {
+        throw std::runtime_error("object " + sha + " is not a " +
+                                 Header(*expectedType, 0).typeAsString());
+    }
+}
+
+}
+
+ObjectDatabase::ObjectDatabase(fs::path objectsDir):
+    objectsDir(std::move(objectsDir)),
+    packSet(std::make_unique<PackSet>(this->objectsDir / "pack"))
+{
+    // the index reaches the packs through the PackSet rather than through
+    // this, so it keeps working after the database is moved
+    PackSet* packs = packSet.get();
+    index = std::make_unique<ObjectIndex>(this->objectsDir, [packs]() -> const std::vector<std::unique_ptr<PackFile>>&
+    {
+        return packs->get();
+    });
+}
+
+const std::vector<std::unique_ptr<PackFile>>& ObjectDatabase::packs() const
+{
+    return packSet->get();
+}
+
+const std::vector<std::unique_ptr<PackFile>>& ObjectDatabase::PackSet::get()
+{
+    std::lock_guard lock(mutex);
+    if (opened)
+    {
+        return files;
+    }
+
+    std::error_code ec;
+    for (const fs::directory_entry& packEntry : fs::directory_iterator(packDir, ec))
+    {
+        fs::path packPath = packEntry.path();
+        if (packPath.extension() != ".pack" || !fs::exists(fs::path(packPath).replace_extension(".idx"), ec))
+        {
+            continue;
+        }
+        // one unreadable pack must not make every other object unreachable
+        try
+        {
+            files.push_back(std::make_unique<PackFile>(packPath));
+        } catch (const std::exception&)
+        {
+        }
+    }
+    opened = true;
+    return files;
+}
+
+void ObjectDatabase::PackSet::clear()
+{
+    std::lock_guard lock(mutex);
+    files.clear();
+    opened = false;
+}
+
+fs::path ObjectDatabase::objectPath(const std::string& sha) const
+{
+    if (sha.length() < 3)
+    {
+        throw std::runtime_error("git object name must be at least 3 characters long!");
+    }
+    GitObject object(sha);
+    return objectsDir / object.dirName / object.fileName;
+}
+
+bool ObjectDatabase::hasObject(const std::string& sha) const
+{
+    ObjectId id;
+    if (parseObjectId(sha, id))
+    {
+        return hasObject(id);
+    }
+    std::error_code ec;
+    return fs::exists(objectPath(sha), ec);
+}
+
+bool ObjectDatabase::hasObject(const ObjectId& id) const
+{
+    return index->contains(id);
+}
+
+void ObjectDatabase::refresh()
+{
+    // the index points into the open packs, so it is dropped first
+    index->refresh();
+    packSet->clear();
+}
+
+RawObject ObjectDatabase::readObject(const std::string& sha) const
+{
+    ObjectId id;
+    fs::path path = objectPath(sha);
+    std::error_code ec;
+    if (parseObjectId(sha, id) && !fs::exists(path, ec) && !packs().empty())
+    {
+        return readPackedObject(id);
+    }
+
+    std::string decompressed;
+    zlibDecompression(decompressed, path);
+
+    size_t nullPos = decompressed.find('\0');
+    if (nullPos == std::string::npos)
+    {
+        throw std::runtime_error("Missing null pointer between header and content");
+    }
+    Header header = Header::parse(std::string_view(decompressed).substr(0, nullPos));
+    if (header.size != decompressed.size() - nullPos - 1)
+    {
+        throw std::runtime_error("object " + sha + " size does not match its header");
+    }
+
+    decompressed.erase(0, nullPos + 1);
+    return RawObject{header.type, std::move(decompressed)};
+}
+
+RawObject ObjectDatabase::readObject(const ObjectId& id) const
+{
+    return readObject(objectIdToHex(id));
+}
+
+RawObject ObjectDatabase::readDeltaBase(const ObjectId& id, unsigned depth) const
+{
+    std::string sha = objectIdToHex(id);
+    std::error_code ec;
+    if (fs::exists(objectPath(sha), ec))
+    {
+        return readObject(sha);
+    }
+    return readPackedObject(id, depth);
+}
+
+RawObject ObjectDatabase::readPackedObject(const ObjectId& id, unsigned depth) const
+{
+    for (const std::unique_ptr<PackFile>& pack : packs())
+    {
+        if (pack->contains(id))
+        {
+            return pack->read(id, [this](const ObjectId& baseId, unsigned baseDepth)
+            {
+                return readDeltaBase(baseId, baseDepth);
+            }, depth);
+        }
+    }
+    throw std::runtime_error("object " + objectIdToHex(id) + " not found");
+}
+
+std::string ObjectDatabase::readLooseObjectData(const ObjectId& id) const
+{
+    std::string decompressed;
+    zlibDecompression(decompressed, objectPath(objectIdToHex(id)));
+    return decompressed;
+}
+
+std::vector<ObjectId> ObjectDatabase::listLooseObjects() const
+{
+    std::vector<ObjectId> ids;
+    listLooseObjectIds(objectsDir, ids);
+    return ids;
+}
+
+std::optional<Header> ObjectDatabase::readPackedHeader(const ObjectId& id) const
+{
+    for (const std::unique_ptr<PackFile>& pack : packs())
+    {
+        if (pack->contains(id))
+        {
+            return pack->readHeader(id, [this](const ObjectId& baseId, unsigned baseDepth)
+            {
+                return readDeltaBase(baseId, baseDepth);
+            });
+        }
+    }
+    return std::nullopt;
+}
+
+Header ObjectDatabase::readHeader(const std::string& sha) const
+{
+    ObjectId id;
+    std::error_code ec;
+    if (parseObjectId(sha, id) && !fs::exists(objectPath(sha), ec))
+    {
+        if (std::optional<Header> header = readPackedHeader(id))
+        {
+            return *header;
+        }
+    }
+
+    std::string prefix = zlibDecompressionPrefix(objectPath(sha), MAX_HEADER_SIZE);
+    size_t nullPos = prefix.find('\0');
+    if (nullPos == std::string::npos)
+    {
+        throw std::runtime_error("Missing null pointer between header and content");
+    }
+    return Header::parse(std::string_view(prefix).substr(0, nullPos));
+}
+
+std::optional<RawObject> ObjectDatabase::readObjectIfSmall(const std::string& sha,
+                                                          size_t sizeLimit,
+                                                          Header& header) const
+{
+    ObjectId id;
+    std::error_code ec;
+    if (parseObjectId(sha, id) && !fs::exists(objectPath(sha), ec))
+    {
+        if (std::optional<Header> packed = readPackedHeader(id))
+        {
+            header = *packed;
+            if (header.size > sizeLimit) return std::nullopt;
+            return readPackedObject(id);
+        }
+    }
+
+    // inflating one byte past the largest accepted object either yields the
+    // whole object or shows that it is too large, in a single pass
+    std::string prefix = zlibDecompressionPrefix(objectPath(sha), MAX_HEADER_SIZE + sizeLimit + 1);
+    size_t nullPos = prefix.find('\0');
+    if (nullPos == std::string::npos)
+    {
+        throw std::runtime_error("Missing null pointer between header and content");
+    }
+    header = Header::parse(std::string_view(prefix).substr(0, nullPos));
+    if (header.size > sizeLimit)
+    {
+        return std::nullopt;
+    }
+    if (header.size != prefix.size() - nullPos - 1)
+    {
+        throw std::runtime_error("object " + sha + " size does not match its header");
+    }
+    prefix.erase(0, nullPos + 1);
+    return RawObject{header.type, std::move(prefix)};
+}
+
+Header ObjectDatabase::streamObject(const std::string& sha,
+                                   const ObjectSink& sink,
+                                   std::optional<ObjectType> expectedType) const
+{
+    // whole pack entries are inflated chunk by chunk as well; only delta
+    // results are rebuilt in memory
+    ObjectId id;
+    std::error_code ec;
+    if (parseObjectId(sha, id) && !fs::exists(objectPath(sha), ec))
+    {
+        for (const std::unique_ptr<PackFile>& pack : packs())
+        {
+            if (!pack->contains(id)) continue;
+            return pack->stream(id, [this](const ObjectId& baseId, unsigned baseDepth)
+            {
+                return readDeltaBase(baseId, baseDepth);
+            }, [&](const Header& header)
+            {
+                checkObjectType(sha, header, expectedType);
+            }, sink);
+        }
+    }
+
+    std::string headerText;
+    std::optional<Header> header;
+    size_t written = 0;
+
+    zlibDecompressionStream(objectPath(sha), [&](std::string_view chunk)
+    {
+        if (!header)
+        {
+            size_t nullPos = chunk.find('\0');
+            if (nullPos == std::string_view::npos)
+            {
+                headerText.append(chunk);
+                if (headerText.size() > MAX_HEADER_SIZE)
+                {
+                    throw std::runtime_error("Missing null pointer between header and content");
+                }
+                return;
+            }
+            headerText.append(chunk.substr(0, nullPos));
+            header = Header::parse(headerText);
+            checkObjectType(sha, *header, expectedType);
+            chunk.remove_prefix(nullPos + 1);
+        }
+
+        if (chunk.size() > header->size - written)
+        {
+            throw std::runtime_error("object " + sha + " is larger than its header");
+        }
+        written += chunk.size();
+        if (!chunk.empty())
+        {
+            sink(chunk);
+        }
+    });
+
+    if (!header)
+    {
+        throw std::runtime_error("Missing null pointer between header and content");
+    }
+    if (written != header->size)
+    {
+        throw std::runtime_error("object " + sha + " size does not match its header");
+    }
+    return *header;
+}
+
+std::string ObjectDatabase::writeObject(ObjectType type, std::string_view content)
+{
+    return writeObject(type, std::vector<std::string_view>{content});
+}
+
+std::string ObjectDatabase::writeObject(ObjectType type, std::vector<std::string_view> segments)
+{
+    ObjectWriter writer(type, std::move(segments));
+    ObjectId id;
+    parseObjectId(writer.sha(), id);
+    if (hasObject(id))
+    {
+        return writer.sha();
+    }
+
+    writer.store(objectsDir);
+    index->insert(id);
+    return writer.sha();
+}
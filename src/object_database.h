@@ -0,0 +1,102 @@
+#pragma once
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "git_object.h"
+#include "object_index.h"
+#include "pack_file.h"
+
+// receives consecutive pieces of an object's content while it is inflated
+using ObjectSink = std::function<void(std::string_view chunk)>;
+
+struct RawObject {
+    ObjectType type;
+    std::string content;
+};
+
+// Object store rooted at a `.git/objects` directory: loose objects plus any
+// packs under `objects/pack`, which are read-only. Open it once and reuse it
+// for any number of reads and writes; nothing is printed, every result is
+// returned to the caller and failures are thrown.
+class ObjectDatabase{
+    public:
+        explicit ObjectDatabase(std::filesystem::path objectsDir);
+
+        const std::filesystem::path& directory() const { return objectsDir; }
+        std::filesystem::path objectPath(const std::string& sha) const;
+
+        // full 40 character ids are answered from the in-memory existence
+        // index; abbreviated ids fall back to a filesystem check
+        bool hasObject(const std::string& sha) const;
+        bool hasObject(const ObjectId& id) const;
+        ObjectIndex& existenceIndex() const { return *index; }
+        // drop the existence index and the open packs so objects and packs
+        // added by other processes become visible; must not run while other
+        // threads use this database
+        void refresh();
+        // every readable pack, opened on first use; a pack whose .idx is
+        // missing (e.g. mid-fetch) or that fails to open is left out
+        const std::vector<std::unique_ptr<PackFile>>& packs() const;
+        // every loose object name found in the fan-out directories
+        std::vector<ObjectId> listLooseObjects() const;
+        RawObject readObject(const std::string& sha) const;
+        RawObject readObject(const ObjectId& id) const;
+        // read the base of a REF_DELTA that lives outside the pack being
+        // read; meant as a PackFile::BaseResolver so that depth keeps
+        // counting when a chain continues in another pack
+        RawObject readDeltaBase(const ObjectId& id, unsigned depth) const;
+        // inflate a loose object file without consulting packs and without
+        // checking its header against the content
+        std::string readLooseObjectData(const ObjectId& id) const;
+        // type and size of an object, inflating no more of it than needed
+        Header readHeader(const std::string& sha) const;
+        // the same from a pack entry alone, with no file I/O; std::nullopt
+        // when no readable pack holds the object
+        std::optional<Header> readPackedHeader(const ObjectId& id) const;
+        // read an object whole if its content is at most sizeLimit bytes;
+        // otherwise return std::nullopt having inflated at most about
+        // sizeLimit bytes. header is set either way.
+        std::optional<RawObject> readObjectIfSmall(const std::string& sha,
+                                                   size_t sizeLimit,
+                                                   Header& header) const;
+        // validate the header, then inflate the content chunk by chunk into
+        // sink without holding the whole object in memory (except packed
+        // deltas, which are rebuilt first); when expectedType is given a
+        // mismatching object is rejected before any output
+        Header streamObject(const std::string& sha,
+                            const ObjectSink& sink,
+                            std::optional<ObjectType> expectedType = std::nullopt) const;
+        // hashes "<type> <size>\0<content>", stores it unless already present
+        // and returns the 40 character hex id
+        std::string writeObject(ObjectType type, std::string_view content);
+        // same, with the content given as consecutive segments that are
+        // hashed and deflated in place (see ObjectWriter)
+        std::string writeObject(ObjectType type, std::vector<std::string_view> segments);
+
+    private:
+        // the packs under objects/pack, opened on first use; kept on the
+        // heap so its address survives moving the database
+        struct PackSet {
+            explicit PackSet(std::filesystem::path packDir): packDir(std::move(packDir)) {}
+
+            const std::vector<std::unique_ptr<PackFile>>& get();
+            void clear();
+
+            std::filesystem::path packDir;
+            std::mutex mutex;
+            bool opened = false;
+            std::vector<std::unique_ptr<PackFile>> files;
+        };
+
+        RawObject readPackedObject(const ObjectId& id, unsigned depth = 0) const;
+
+        std::filesystem::path objectsDir;
+        std::unique_ptr<PackSet> packSet;
+        std::unique_ptr<ObjectIndex> index;
+};
@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "object_index.h"
+#include "pack_file.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+int hexValue(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// append the name of every loose object in one fan-out directory
+void listFanoutDirectory(const fs::path& dir, const std::string& dirName, std::vector<ObjectId>& ids)
+{
+    std::error_code ec;
+    for (const fs::directory_entry& objectEntry : fs::directory_iterator(dir, ec))
+    {
+        // every 38 hex character file name is a loose object
+        ObjectId id;
+        if (parseObjectId(dirName + objectEntry.path().filename().string(), id))
+        {
+            ids.push_back(id);
+        }
+    }
+}
+
+std::string fanoutDirectoryName(unsigned char firstByte)
+{
+    static const char digits[] = "0123456789abcdef";
+    return {digits[firstByte >> 4], digits[firstByte & 0x0f]};
+}
+
+}
+
+bool parseObjectId(std::string_view hexHash, ObjectId& id)
+{
+    if (hexHash.size() != id.size() * 2)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < id.size(); i++)
+    {
+        int high = hexValue(hexHash[2 * i]);
+        int low = hexValue(hexHash[2 * i + 1]);
+        if (high < 0 || low < 0)
+        {
+            return false;
+        }
+        id[i] = static_cast<unsigned char>((high << 4) | low);
+    }
+    return true;
+}
+
+std::string objectIdToHex(const ObjectId& id)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string hexHash(id.size() * 2, '0');
+    for (size_t i = 0; i < id.size(); i++)
+    {
+        hexHash[2 * i] = digits[id[i] >> 4];
+        hexHash[2 * i + 1] = digits[id[i] & 0x0f];
+    }
+    return hexHash;
+}
+
+void listLooseObjectIds(const fs::path& objectsDir, std::vector<ObjectId>& ids)
+{
+    std::error_code ec;
+    for (const fs::directory_entry& dirEntry : fs::directory_iterator(objectsDir, ec))
+    {
+        std::string dirName = dirEntry.path().filename().string();
+        if (dirName.size() != 2 || hexValue(dirName[0]) < 0 || hexValue(dirName[1]) < 0)
+        {
+            continue;
+        }
+        listFanoutDirectory(dirEntry.path(), dirName, ids);
+    }
+}
+
+ObjectIndex::ObjectIndex(fs::path objectsDir, PackSource packs):
+    objectsDir(std::move(objectsDir)),
+    packs(std::move(packs))
+{
+}
+
+ObjectIndex::~ObjectIndex() = default;
+
+bool ObjectIndex::contains(const ObjectId& id)
+{
+    std::shared_lock lock(mutex);
+    if (!packIndexesOpened || !buckets[id[0]].loaded)
+    {
+        lock.unlock();
+        ensureLoaded(id[0]);
+        lock.lock();
+    }
+
+    const std::vector<ObjectId>& ids = buckets[id[0]].ids;
+    if (std::binary_search(ids.begin(), ids.end(), id))
+    {
+        return true;
+    }
+    for (const PackIndex* packIndex : packIndexes)
+    {
+        if (packIndex->find(id))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ObjectIndex::insert(const ObjectId& id)
+{
+    std::unique_lock lock(mutex);
+    FanoutBucket& bucket = buckets[id[0]];
+    if (!bucket.loaded) return;
+
+    auto pos = std::lower_bound(bucket.ids.begin(), bucket.ids.end(), id);
+    if (pos == bucket.ids.end() || *pos != id)
+    {
+        bucket.ids.insert(pos, id);
+    }
+}
+
+size_t ObjectIndex::size()
+{
+    std::vector<ObjectId> all;
+    for (size_t firstByte = 0; firstByte < buckets.size(); firstByte++)
+    {
+        ensureLoaded(static_cast<unsigned char>(firstByte));
+    }
+    std::shared_lock lock(mutex);
+    for (const FanoutBucket& bucket : buckets)
+    {
+        all.insert(all.end(), bucket.ids.begin(), bucket.ids.end());
+    }
+    for (const PackIndex* packIndex : packIndexes)
+    {
+        for (size_t i = 0; i < packIndex->count(); i++)
+        {
+            all.push_back(packIndex->id(i));
+        }
+    }
+    std::sort(all.begin(), all.end());
+    return std::unique(all.begin(), all.end()) - all.begin();
+}
+
+void ObjectIndex::refresh()
+{
+    std::unique_lock lock(mutex);
+    for (FanoutBucket& bucket : buckets)
+    {
+        bucket.loaded = false;
+        bucket.ids.clear();
+    }
+    packIndexes.clear();
+    packIndexesOpened = false;
+}
+
+void ObjectIndex::ensureLoaded(unsigned char firstByte)
+{
+    {
+        std::shared_lock lock(mutex);
+        if (packIndexesOpened && buckets[firstByte].loaded) return;
+    }
+    std::unique_lock lock(mutex);
+    if (!packIndexesOpened)
+    {
+        openPackIndexes();
+        packIndexesOpened = true;
+    }
+    FanoutBucket& bucket = buckets[firstByte];
+    if (!bucket.loaded)
+    {
+        std::string dirName = fanoutDirectoryName(firstByte);
+        listFanoutDirectory(objectsDir / dirName, dirName, bucket.ids);
+        std::sort(bucket.ids.begin(), bucket.ids.end());
+        bucket.loaded = true;
+    }
+}
+
+void ObjectIndex::openPackIndexes()
+{
+    // an index whose pack is missing or damaged names objects that cannot be
+    // read, so only the indexes of packs that opened are searched
+    for (const std::unique_ptr<PackFile>& pack : packs())
+    {
+        packIndexes.push_back(&pack->index());
+    }
+}
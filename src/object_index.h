@@ -0,0 +1,81 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// raw 20 byte SHA-1 object name
+using ObjectId = std::array<unsigned char, 20>;
+
+// ids are already uniformly distributed, so their first bytes make a good hash
+struct ObjectIdHash {
+    size_t operator()(const ObjectId& id) const
+    {
+        size_t hash;
+        std::memcpy(&hash, id.data(), sizeof(hash));
+        return hash;
+    }
+};
+
+bool parseObjectId(std::string_view hexHash, ObjectId& id);
+std::string objectIdToHex(const ObjectId& id);
+// append the name of every loose object under objectsDir's fan-out directories
+void listLooseObjectIds(const std::filesystem::path& objectsDir, std::vector<ObjectId>& ids);
+
+class PackFile;
+class PackIndex;
+
+// In-memory answer to "does object X exist?". Loose ids are kept per fan-out
+// directory: the first query for an id whose first byte is b lists
+// `objects/<b>` once into a sorted array. Packed ids are binary searched in
+// the indexes of the packs handed out by `packs`, so only packs that opened
+// and can be read count as holding their objects. After that, lookups in that
+// fan-out directory make no syscalls. Objects written through the owning
+// ObjectDatabase are added as they are stored. Inserts into a directory that
+// has not been listed yet are dropped, since listing it picks them up anyway.
+//
+// Once loaded, the index is authoritative: a miss is final until refresh()
+// drops everything loaded so far, so objects written by other processes
+// are not seen before that.
+//
+// Safe to query from several threads at once.
+class ObjectIndex{
+    public:
+        // the packs whose objects count as present; called once per load
+        using PackSource = std::function<const std::vector<std::unique_ptr<PackFile>>&()>;
+
+        ObjectIndex(std::filesystem::path objectsDir, PackSource packs);
+        ~ObjectIndex();
+
+        bool contains(const ObjectId& id);
+        void insert(const ObjectId& id);
+        // number of distinct known objects; lists every fan-out directory
+        size_t size();
+        // forget what was loaded; the next queries re-read the disk
+        void refresh();
+
+    private:
+        // the loose ids of one fan-out directory, sorted ascending
+        struct FanoutBucket {
+            bool loaded = false;
+            std::vector<ObjectId> ids;
+        };
+
+        void ensureLoaded(unsigned char firstByte);
+        void openPackIndexes();
+
+        std::filesystem::path objectsDir;
+        PackSource packs;
+        std::shared_mutex mutex;
+        bool packIndexesOpened = false;
+        // owned by the PackFiles that packs() returned
+        std::vector<const PackIndex*> packIndexes;
+        std::array<FanoutBucket, 256> buckets;
+};
@@ -0,0 +1,112 @@
+#include <climits>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <openssl/evp.h>
+#include <zlib.h>
+
+#include "object_writer.h"
+#include "helper.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const size_t CHUNK_SIZE = 64 * 1024;
+
+}
+
+ObjectWriter::ObjectWriter(ObjectType type, std::vector<std::string_view> segments):
+    segments(std::move(segments))
+{
+    size_t payloadSize = 0;
+    for (std::string_view segment : this->segments)
+    {
+        payloadSize += segment.size();
+    }
+    header = formatObjectHeader(type, payloadSize);
+
+    EVP_MD_CTX* context = EVP_MD_CTX_new();
+    if (!context || EVP_DigestInit_ex(context, EVP_sha1(), nullptr) != 1)
+    {
+        EVP_MD_CTX_free(context);
+        throw std::runtime_error("failed to initialize SHA-1");
+    }
+    EVP_DigestUpdate(context, header.data, header.length);
+    for (std::string_view segment : this->segments)
+    {
+        EVP_DigestUpdate(context, segment.data(), segment.size());
+    }
+    unsigned char byteHash[EVP_MAX_MD_SIZE];
+    unsigned int hashLength = 0;
+    EVP_DigestFinal_ex(context, byteHash, &hashLength);
+    EVP_MD_CTX_free(context);
+
+    byteToHexHash(objectSha, byteHash, hashLength);
+}
+
+void ObjectWriter::store(const fs::path& objectsDir) const
+{
+    GitObject object(objectSha);
+    fs::path folderPath(objectsDir / object.dirName);
+    std::error_code ec;
+    fs::create_directories(folderPath, ec);
+    if (ec)
+    {
+        throw std::runtime_error("failed to create directory " + folderPath.string());
+    }
+
+    std::string temporary((folderPath / "tmp_obj_XXXXXX").string());
+    int fd = mkstemp(temporary.data());
+    if (fd < 0)
+    {
+        throw std::runtime_error("failed to create or open file " + temporary);
+    }
+
+    z_stream strm{};
+    if (deflateInit(&strm, Z_DEFAULT_COMPRESSION) != Z_OK)
+    {
+        close(fd);
+        unlink(temporary.c_str());
+        throw std::runtime_error("deflateInit failed");
+    }
+
+    std::vector<unsigned char> buffer(CHUNK_SIZE);
+    bool ok = true;
+    // deflate one piece of input, writing compressed output as it fills up
+    auto deflatePiece = [&](std::string_view piece, int flush)
+    {
+        do{
+            size_t take = std::min<size_t>(piece.size(), UINT_MAX);
+            strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(piece.data()));
+            strm.avail_in = static_cast<uInt>(take);
+            int pieceFlush = take == piece.size() ? flush : Z_NO_FLUSH;
+            do{
+                strm.next_out = buffer.data();
+                strm.avail_out = buffer.size();
+                deflate(&strm, pieceFlush);
+                size_t produced = buffer.size() - strm.avail_out;
+                std::string_view out(reinterpret_cast<const char*>(buffer.data()), produced);
+                ok = ok && writeAllToFd(fd, out);
+            } while (strm.avail_out == 0);
+            piece.remove_prefix(take);
+        } while (!piece.empty());
+    };
+
+    deflatePiece(header.view(), segments.empty() ? Z_FINISH : Z_NO_FLUSH);
+    for (size_t i = 0; i < segments.size(); i++)
+    {
+        deflatePiece(segments[i], i + 1 == segments.size() ? Z_FINISH : Z_NO_FLUSH);
+    }
+    deflateEnd(&strm);
+
+    // objects are immutable once written
+    fchmod(fd, 0444);
+    ok = close(fd) == 0 && ok;
+    if (!ok || rename(temporary.c_str(), (folderPath / object.fileName).c_str()) != 0)
+    {
+        unlink(temporary.c_str());
+        throw std::runtime_error("failed to write object " + objectSha);
+    }
+}
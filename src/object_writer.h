@@ -0,0 +1,69 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "git_object.h"
+
+// "<type> <size>\0", formatted without allocating
+struct ObjectHeaderText {
+    char data[32] = {};
+    size_t length = 0;
+
+    constexpr std::string_view view() const { return std::string_view(data, length); }
+};
+
+constexpr ObjectHeaderText formatObjectHeader(ObjectType type, size_t size)
+{
+    ObjectHeaderText text;
+    std::string_view name = type == ObjectType::blob ? "blob" :
+                            type == ObjectType::tree ? "tree" :
+                            type == ObjectType::commit ? "commit" : "tag";
+    for (char c : name)
+    {
+        text.data[text.length++] = c;
+    }
+    text.data[text.length++] = ' ';
+
+    char digits[20] = {};
+    size_t digitCount = 0;
+    do{
+        digits[digitCount++] = static_cast<char>('0' + size % 10);
+        size /= 10;
+    } while (size > 0);
+    while (digitCount > 0)
+    {
+        text.data[text.length++] = digits[--digitCount];
+    }
+    text.data[text.length++] = '\0';
+    return text;
+}
+
+static_assert(formatObjectHeader(ObjectType::blob, 0).view() == std::string_view("blob 0\0", 7));
+static_assert(formatObjectHeader(ObjectType::commit, 1234).view() == std::string_view("commit 1234\0", 12));
+
+// One object given as its type and a list of payload segments. The header
+// and the segments are fed to SHA-1, and later to deflate, one after the
+// other, so "<header>\0<payload>" is never built in memory. The segments
+// must stay alive as long as the writer.
+class ObjectWriter{
+    public:
+        ObjectWriter(ObjectType type, std::vector<std::string_view> segments);
+        ObjectWriter(ObjectType type, std::initializer_list<std::string_view> segments):
+            ObjectWriter(type, std::vector<std::string_view>(segments)) {}
+
+        // 40 character hex id, computed on construction
+        const std::string& sha() const { return objectSha; }
+
+        // deflate into a temporary file in the fan-out directory and rename
+        // it into place, so readers never see a partial object
+        void store(const std::filesystem::path& objectsDir) const;
+
+    private:
+        ObjectHeaderText header;
+        std::vector<std::string_view> segments;
+        std::string objectSha;
+};
@@ -0,0 +1,646 @@
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "pack_file.h"
+#include "object_database.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+uint32_t readBigEndian32(const unsigned char* bytes)
+{
+    return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) |
+           (uint32_t(bytes[2]) << 8) | uint32_t(bytes[3]);
+}
+
+// content bytes of resolved delta bases kept per pack
+const size_t DELTA_BASE_CACHE_LIMIT = 32 * 1024 * 1024;
+
+// pack entry type numbers from the pack format
+enum PackEntryType {
+    PACK_COMMIT = 1,
+    PACK_TREE = 2,
+    PACK_BLOB = 3,
+    PACK_TAG = 4,
+    PACK_OFS_DELTA = 6,
+    PACK_REF_DELTA = 7
+};
+
+ObjectType packEntryObjectType(int packType)
+{
+    switch (packType)
+    {
+        case PACK_COMMIT: return ObjectType::commit;
+        case PACK_TREE: return ObjectType::tree;
+        case PACK_BLOB: return ObjectType::blob;
+        case PACK_TAG: return ObjectType::tag;
+        default: throw std::runtime_error("invalid pack entry type " + std::to_string(packType));
+    }
+}
+
+// inflate a zlib stream that starts at `input` and must produce exactly `expectedSize` bytes
+std::string inflateExact(const unsigned char* input, size_t available, size_t expectedSize)
+{
+    // one spare byte so an oversized stream is detected instead of truncated
+    std::string output(expectedSize + 1, '\0');
+
+    z_stream strm{};
+    strm.next_in = const_cast<Bytef*>(input);
+    strm.avail_in = static_cast<uInt>(std::min<size_t>(available, UINT_MAX));
+    strm.next_out = reinterpret_cast<Bytef*>(output.data());
+    strm.avail_out = static_cast<uInt>(output.size());
+
+    if (inflateInit(&strm) != Z_OK)
+    {
+        throw std::runtime_error("inflateInit failed");
+    }
+    int ret = inflate(&strm, Z_FINISH);
+    size_t produced = strm.total_out;
+    inflateEnd(&strm);
+
+    if (ret != Z_STREAM_END || produced != expectedSize)
+    {
+        throw std::runtime_error("corrupt pack entry data");
+    }
+    output.resize(expectedSize);
+    return output;
+}
+
+// inflate a zlib stream that starts at `input` and must produce exactly
+// `expectedSize` bytes, passing the output to sink one buffer at a time. The
+// input is fed in windows, and each fully consumed window is handed to
+// release so a mapping does not keep the whole entry resident.
+void inflateExactChunked(const unsigned char* input, size_t available, size_t expectedSize,
+                         const std::function<void(std::string_view)>& sink,
+                         const std::function<void(const unsigned char*, size_t)>& release)
+{
+    const size_t CHUNK_SIZE = 64 * 1024;
+    const size_t INPUT_WINDOW = 1024 * 1024;
+    std::vector<char> buffer(CHUNK_SIZE);
+
+    z_stream strm{};
+    if (inflateInit(&strm) != Z_OK)
+    {
+        throw std::runtime_error("inflateInit failed");
+    }
+
+    const unsigned char* window = input;
+    size_t windowSize = 0;
+    size_t produced = 0;
+    int ret = Z_OK;
+    while (ret != Z_STREAM_END)
+    {
+        if (strm.avail_in == 0)
+        {
+            if (windowSize > 0)
+            {
+                release(window, windowSize);
+            }
+            window += windowSize;
+            windowSize = std::min(available, INPUT_WINDOW);
+            available -= windowSize;
+            if (windowSize == 0) break;
+            strm.next_in = const_cast<Bytef*>(window);
+            strm.avail_in = static_cast<uInt>(windowSize);
+        }
+        strm.next_out = reinterpret_cast<Bytef*>(buffer.data());
+        strm.avail_out = static_cast<uInt>(buffer.size());
+        ret = inflate(&strm, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END)
+        {
+            break;
+        }
+
+        size_t chunkSize = buffer.size() - strm.avail_out;
+        if (chunkSize > expectedSize - produced)
+        {
+            break;
+        }
+        produced += chunkSize;
+        if (chunkSize > 0)
+        {
+            sink(std::string_view(buffer.data(), chunkSize));
+        }
+    }
+    inflateEnd(&strm);
+
+    if (ret != Z_STREAM_END || produced != expectedSize)
+    {
+        throw std::runtime_error("corrupt pack entry data");
+    }
+}
+
+// inflate at most the first `length` bytes of a zlib stream
+std::string inflatePrefix(const unsigned char* input, size_t available, size_t length)
+{
+    std::string output(length, '\0');
+
+    z_stream strm{};
+    strm.next_in = const_cast<Bytef*>(input);
+    strm.avail_in = static_cast<uInt>(std::min<size_t>(available, UINT_MAX));
+    strm.next_out = reinterpret_cast<Bytef*>(output.data());
+    strm.avail_out = static_cast<uInt>(output.size());
+
+    if (inflateInit(&strm) != Z_OK)
+    {
+        throw std::runtime_error("inflateInit failed");
+    }
+    int ret = inflate(&strm, Z_SYNC_FLUSH);
+    size_t produced = strm.total_out;
+    inflateEnd(&strm);
+
+    if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+    {
+        throw std::runtime_error("corrupt pack entry data");
+    }
+    output.resize(produced);
+    return output;
+}
+
+size_t readDeltaSize(const std::string& delta, size_t& pos)
+{
+    size_t size = 0;
+    int shift = 0;
+    unsigned char c;
+    do{
+        if (pos >= delta.size())
+        {
+            throw std::runtime_error("truncated delta header");
+        }
+        if (shift >= 64)
+        {
+            throw std::runtime_error("delta size too large");
+        }
+        c = static_cast<unsigned char>(delta[pos++]);
+        size |= size_t(c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    return size;
+}
+
+std::string applyDelta(const std::string& base, const std::string& delta)
+{
+    size_t pos = 0;
+    size_t baseSize = readDeltaSize(delta, pos);
+    size_t resultSize = readDeltaSize(delta, pos);
+    if (baseSize != base.size())
+    {
+        throw std::runtime_error("delta base size mismatch");
+    }
+
+    std::string result;
+    result.reserve(resultSize);
+    while (pos < delta.size())
+    {
+        unsigned char op = static_cast<unsigned char>(delta[pos++]);
+        if (op & 0x80)
+        {
+            // copy from base: bits 0-3 select offset bytes, bits 4-6 size bytes
+            size_t copyOffset = 0;
+            size_t copySize = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                if (op & (1 << i))
+                {
+                    if (pos >= delta.size()) throw std::runtime_error("truncated delta copy");
+                    copyOffset |= size_t(static_cast<unsigned char>(delta[pos++])) << (8 * i);
+                }
+            }
+            for (int i = 0; i < 3; i++)
+            {
+                if (op & (0x10 << i))
+                {
+                    if (pos >= delta.size()) throw std::runtime_error("truncated delta copy");
+                    copySize |= size_t(static_cast<unsigned char>(delta[pos++])) << (8 * i);
+                }
+            }
+            if (copySize == 0) copySize = 0x10000;
+            if (copyOffset > base.size() || copySize > base.size() - copyOffset)
+            {
+                throw std::runtime_error("delta copy out of range");
+            }
+            result.append(base, copyOffset, copySize);
+        }
+        else if (op != 0)
+        {
+            // insert the next `op` literal bytes
+            if (op > delta.size() - pos)
+            {
+                throw std::runtime_error("truncated delta insert");
+            }
+            result.append(delta, pos, op);
+            pos += op;
+        }
+        else
+        {
+            throw std::runtime_error("invalid delta opcode");
+        }
+    }
+
+    if (result.size() != resultSize)
+    {
+        throw std::runtime_error("delta result size mismatch");
+    }
+    return result;
+}
+
+}
+
+MappedFile::MappedFile(const fs::path& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("failed to open file " + path.string());
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        ::close(fd);
+        throw std::runtime_error("failed to stat file " + path.string());
+    }
+    length = static_cast<size_t>(info.st_size);
+    if (length > 0)
+    {
+        void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED)
+        {
+            ::close(fd);
+            throw std::runtime_error("failed to map file " + path.string());
+        }
+        bytes = static_cast<const unsigned char*>(mapping);
+    }
+    ::close(fd);
+}
+
+void MappedFile::dropPages(const unsigned char* begin, size_t length) const
+{
+    // only whole pages inside the range can go; the mapping is read-only, so
+    // dropped pages are simply read from the file again if touched later
+    const uintptr_t pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    uintptr_t first = (reinterpret_cast<uintptr_t>(begin) + pageSize - 1) & ~(pageSize - 1);
+    uintptr_t last = (reinterpret_cast<uintptr_t>(begin) + length) & ~(pageSize - 1);
+    if (last > first)
+    {
+        madvise(reinterpret_cast<void*>(first), last - first, MADV_DONTNEED);
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    if (bytes)
+    {
+        munmap(const_cast<unsigned char*>(bytes), length);
+    }
+}
+
+std::shared_ptr<const RawObject> DeltaBaseCache::find(uint64_t offset)
+{
+    std::lock_guard lock(mutex);
+    auto found = byOffset.find(offset);
+    if (found == byOffset.end())
+    {
+        return nullptr;
+    }
+    entries.splice(entries.begin(), entries, found->second);
+    return found->second->second;
+}
+
+void DeltaBaseCache::insert(uint64_t offset, std::shared_ptr<const RawObject> base)
+{
+    size_t baseBytes = base->content.size();
+    if (baseBytes > byteLimit)
+    {
+        return;
+    }
+
+    std::lock_guard lock(mutex);
+    if (byOffset.count(offset))
+    {
+        return;
+    }
+    while (bytes + baseBytes > byteLimit)
+    {
+        bytes -= entries.back().second->content.size();
+        byOffset.erase(entries.back().first);
+        entries.pop_back();
+    }
+    entries.emplace_front(offset, std::move(base));
+    byOffset.emplace(offset, entries.begin());
+    bytes += baseBytes;
+}
+
+PackIndex::PackIndex(const fs::path& idxPath): path(idxPath), file(idxPath)
+{
+    // version 2 starts with "\377tOc" and a version number; version 1 starts
+    // straight with the fan-out table and stores "<4 byte offset><20 byte id>"
+    const unsigned char MAGIC[4] = {0xff, 't', 'O', 'c'};
+    const unsigned char* data = file.data();
+    isVersion2 = file.size() >= 8 && std::equal(MAGIC, MAGIC + 4, data);
+    fanoutOffset = isVersion2 ? 8 : 0;
+    if (isVersion2 && readBigEndian32(data + 4) != 2)
+    {
+        throw std::runtime_error("unsupported pack index version in " + path.string());
+    }
+    if (file.size() < fanoutOffset + 256 * 4)
+    {
+        throw std::runtime_error("truncated pack index " + path.string());
+    }
+
+    // find() uses neighbouring fan-out entries as bounds into the name table,
+    // so they must never decrease; the last one is the object count
+    objectCount = readBigEndian32(data + fanoutOffset + 255 * 4);
+    uint32_t previous = 0;
+    for (size_t i = 0; i < 256; i++)
+    {
+        uint32_t entry = readBigEndian32(data + fanoutOffset + i * 4);
+        if (entry < previous)
+        {
+            throw std::runtime_error("non-monotonic fan-out table in pack index " + path.string());
+        }
+        previous = entry;
+    }
+    size_t tablesSize = isVersion2 ? objectCount * (20 + 4 + 4) : objectCount * 24;
+    if (file.size() < fanoutOffset + 256 * 4 + tablesSize)
+    {
+        throw std::runtime_error("truncated pack index " + path.string());
+    }
+}
+
+const unsigned char* PackIndex::nameAt(size_t position) const
+{
+    const unsigned char* table = file.data() + fanoutOffset + 256 * 4;
+    return isVersion2 ? table + position * 20 : table + position * 24 + 4;
+}
+
+ObjectId PackIndex::id(size_t position) const
+{
+    ObjectId objectId;
+    const unsigned char* name = nameAt(position);
+    std::copy(name, name + objectId.size(), objectId.begin());
+    return objectId;
+}
+
+uint64_t PackIndex::offset(size_t position) const
+{
+    const unsigned char* table = file.data() + fanoutOffset + 256 * 4;
+    if (!isVersion2)
+    {
+        return readBigEndian32(table + position * 24);
+    }
+
+    const unsigned char* offsets = table + objectCount * (20 + 4);
+    uint32_t small = readBigEndian32(offsets + position * 4);
+    if (!(small & 0x80000000u))
+    {
+        return small;
+    }
+    // the high bit marks an index into the table of 8 byte offsets
+    size_t largeIndex = small & 0x7fffffffu;
+    const unsigned char* large = offsets + objectCount * 4 + largeIndex * 8;
+    if (large + 8 > file.data() + file.size())
+    {
+        throw std::runtime_error("corrupt large offset in " + path.string());
+    }
+    return (uint64_t(readBigEndian32(large)) << 32) | readBigEndian32(large + 4);
+}
+
+std::optional<uint64_t> PackIndex::find(const ObjectId& id) const
+{
+    const unsigned char* fanout = file.data() + fanoutOffset;
+    size_t low = id[0] == 0 ? 0 : readBigEndian32(fanout + (id[0] - 1) * 4);
+    size_t high = readBigEndian32(fanout + id[0] * 4);
+
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        int cmp = std::memcmp(nameAt(middle), id.data(), id.size());
+        if (cmp == 0) return offset(middle);
+        if (cmp < 0) low = middle + 1;
+        else high = middle;
+    }
+    return std::nullopt;
+}
+
+PackFile::PackFile(const fs::path& packPath):
+    path(packPath),
+    file(packPath),
+    packIndex(fs::path(packPath).replace_extension(".idx")),
+    baseCache(DELTA_BASE_CACHE_LIMIT)
+{
+    const unsigned char* data = file.data();
+    if (file.size() < 12 || std::memcmp(data, "PACK", 4) != 0)
+    {
+        throw std::runtime_error("not a pack file " + path.string());
+    }
+    uint32_t version = readBigEndian32(data + 4);
+    if (version != 2 && version != 3)
+    {
+        throw std::runtime_error("unsupported pack version in " + path.string());
+    }
+    if (readBigEndian32(data + 8) != packIndex.count())
+    {
+        throw std::runtime_error("pack and index object counts differ for " + path.string());
+    }
+}
+
+RawObject PackFile::read(const ObjectId& id, const BaseResolver& resolveExternal, unsigned depth) const
+{
+    std::optional<uint64_t> offset = packIndex.find(id);
+    if (!offset)
+    {
+        throw std::runtime_error("object " + objectIdToHex(id) + " is not in " + path.string());
+    }
+    return readAt(*offset, resolveExternal, depth);
+}
+
+RawObject PackFile::readAt(uint64_t offset, const BaseResolver& resolveExternal, unsigned depth) const
+{
+    // a base that is its own delta, directly or through other objects, would
+    // otherwise recurse until the stack runs out
+    if (depth > MAX_DELTA_DEPTH)
+    {
+        throw std::runtime_error("delta chain deeper than " + std::to_string(MAX_DELTA_DEPTH) +
+                                 " at offset " + std::to_string(offset) + " in " + path.string());
+    }
+    const unsigned char* data = file.data();
+    size_t size = file.size();
+    EntryHeader entry = readEntryHeader(offset);
+    size_t pos = entry.dataOffset;
+
+    if (entry.packType == PACK_OFS_DELTA)
+    {
+        std::shared_ptr<const RawObject> base = readBase(entry.baseOffset, resolveExternal, depth + 1);
+        std::string delta = inflateExact(data + pos, size - pos, entry.size);
+        return RawObject{base->type, applyDelta(base->content, delta)};
+    }
+
+    if (entry.packType == PACK_REF_DELTA)
+    {
+        std::optional<uint64_t> baseOffset = packIndex.find(entry.baseId);
+        std::shared_ptr<const RawObject> base = baseOffset ?
+            readBase(*baseOffset, resolveExternal, depth + 1) :
+            std::make_shared<const RawObject>(resolveExternal(entry.baseId, depth + 1));
+        std::string delta = inflateExact(data + pos, size - pos, entry.size);
+        return RawObject{base->type, applyDelta(base->content, delta)};
+    }
+
+    ObjectType type = packEntryObjectType(entry.packType);
+    return RawObject{type, inflateExact(data + pos, size - pos, entry.size)};
+}
+
+Header PackFile::stream(const ObjectId& id,
+                        const BaseResolver& resolveExternal,
+                        const std::function<void(const Header&)>& onHeader,
+                        const std::function<void(std::string_view)>& sink) const
+{
+    std::optional<uint64_t> offset = packIndex.find(id);
+    if (!offset)
+    {
+        throw std::runtime_error("object " + objectIdToHex(id) + " is not in " + path.string());
+    }
+
+    EntryHeader entry = readEntryHeader(*offset);
+    if (entry.packType == PACK_OFS_DELTA || entry.packType == PACK_REF_DELTA)
+    {
+        // a delta result only exists once it is applied to its whole base
+        RawObject object = readAt(*offset, resolveExternal);
+        Header header(object.type, object.content.size());
+        onHeader(header);
+        if (!object.content.empty())
+        {
+            sink(object.content);
+        }
+        return header;
+    }
+
+    Header header(packEntryObjectType(entry.packType), entry.size);
+    onHeader(header);
+    inflateExactChunked(file.data() + entry.dataOffset, file.size() - entry.dataOffset, entry.size, sink,
+                        [this](const unsigned char* begin, size_t length)
+    {
+        file.dropPages(begin, length);
+    });
+    return header;
+}
+
+PackFile::EntryHeader PackFile::readEntryHeader(uint64_t offset) const
+{
+    const unsigned char* data = file.data();
+    size_t size = file.size();
+    size_t pos = offset;
+    if (pos >= size)
+    {
+        throw std::runtime_error("pack offset out of range in " + path.string());
+    }
+
+    // entry header: type in bits 4-6 of the first byte, size as a little
+    // endian base-128 number starting with the low 4 bits
+    unsigned char c = data[pos++];
+    EntryHeader entry;
+    entry.packType = (c >> 4) & 0x07;
+    entry.size = c & 0x0f;
+    int shift = 4;
+    while (c & 0x80)
+    {
+        if (pos >= size) throw std::runtime_error("truncated pack entry header");
+        if (shift >= 64) throw std::runtime_error("pack entry size too large in " + path.string());
+        c = data[pos++];
+        entry.size |= size_t(c & 0x7f) << shift;
+        shift += 7;
+    }
+
+    // deltas name their base before the data: a negative offset for
+    // OFS_DELTA, the base's object id for REF_DELTA
+    if (entry.packType == PACK_OFS_DELTA)
+    {
+        if (pos >= size) throw std::runtime_error("truncated pack entry header");
+        c = data[pos++];
+        uint64_t distance = c & 0x7f;
+        while (c & 0x80)
+        {
+            if (pos >= size) throw std::runtime_error("truncated pack entry header");
+            c = data[pos++];
+            distance = ((distance + 1) << 7) | (c & 0x7f);
+        }
+        if (distance == 0 || distance > offset)
+        {
+            throw std::runtime_error("invalid delta base offset in " + path.string());
+        }
+        entry.baseOffset = offset - distance;
+    }
+    else if (entry.packType == PACK_REF_DELTA)
+    {
+        if (size - pos < 20) throw std::runtime_error("truncated pack entry header");
+        std::copy(data + pos, data + pos + 20, entry.baseId.begin());
+        pos += 20;
+    }
+    entry.dataOffset = pos;
+    return entry;
+}
+
+Header PackFile::readHeader(const ObjectId& id, const BaseResolver& resolveExternal) const
+{
+    std::optional<uint64_t> offset = packIndex.find(id);
+    if (!offset)
+    {
+        throw std::runtime_error("object " + objectIdToHex(id) + " is not in " + path.string());
+    }
+
+    EntryHeader entry = readEntryHeader(*offset);
+    if (entry.packType != PACK_OFS_DELTA && entry.packType != PACK_REF_DELTA)
+    {
+        return Header(packEntryObjectType(entry.packType), entry.size);
+    }
+
+    // a delta starts with its base size and its result size, each at most
+    // ten base-128 bytes, so only that much of it is inflated
+    std::string prefix = inflatePrefix(file.data() + entry.dataOffset, file.size() - entry.dataOffset,
+                                       std::min<size_t>(entry.size, 20));
+    size_t pos = 0;
+    readDeltaSize(prefix, pos);
+    size_t resultSize = readDeltaSize(prefix, pos);
+
+    // the type is that of the whole object at the bottom of the chain
+    for (unsigned depth = 1; depth <= MAX_DELTA_DEPTH; depth++)
+    {
+        uint64_t baseOffset = entry.baseOffset;
+        if (entry.packType == PACK_REF_DELTA)
+        {
+            std::optional<uint64_t> found = packIndex.find(entry.baseId);
+            if (!found)
+            {
+                return Header(resolveExternal(entry.baseId, depth).type, resultSize);
+            }
+            baseOffset = *found;
+        }
+        entry = readEntryHeader(baseOffset);
+        if (entry.packType != PACK_OFS_DELTA && entry.packType != PACK_REF_DELTA)
+        {
+            return Header(packEntryObjectType(entry.packType), resultSize);
+        }
+    }
+    throw std::runtime_error("delta chain deeper than " + std::to_string(MAX_DELTA_DEPTH) +
+                             " at offset " + std::to_string(*offset) + " in " + path.string());
+}
+
+std::shared_ptr<const RawObject> PackFile::readBase(uint64_t offset,
+                                                   const BaseResolver& resolveExternal,
+                                                   unsigned depth) const
+{
+    std::shared_ptr<const RawObject> base = baseCache.find(offset);
+    if (!base)
+    {
+        base = std::make_shared<const RawObject>(readAt(offset, resolveExternal, depth));
+        baseCache.insert(offset, base);
+    }
+    return base;
+}
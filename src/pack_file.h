@@ -0,0 +1,136 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "git_object.h"
+#include "object_index.h"
+
+struct RawObject;
+
+// Read-only memory mapping of a whole file.
+class MappedFile{
+    public:
+        explicit MappedFile(const std::filesystem::path& path);
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const unsigned char* data() const { return bytes; }
+        size_t size() const { return length; }
+        // let the kernel drop the resident pages that lie wholly inside
+        // [begin, begin + length); later reads fault them back in
+        void dropPages(const unsigned char* begin, size_t length) const;
+
+    private:
+        const unsigned char* bytes = nullptr;
+        size_t length = 0;
+};
+
+// `objects/pack/*.idx`, version 1 or 2: the sorted object names of one pack
+// and the offset of each object inside the pack.
+class PackIndex{
+    public:
+        explicit PackIndex(const std::filesystem::path& idxPath);
+
+        size_t count() const { return objectCount; }
+        ObjectId id(size_t position) const;
+        uint64_t offset(size_t position) const;
+        std::optional<uint64_t> find(const ObjectId& id) const;
+
+    private:
+        const unsigned char* nameAt(size_t position) const;
+
+        std::filesystem::path path;
+        MappedFile file;
+        bool isVersion2 = false;
+        size_t fanoutOffset = 0;
+        size_t objectCount = 0;
+};
+
+// Recently resolved delta bases of one pack, keyed by their offset and
+// bounded by the total size of their content; the least recently used base
+// is dropped first. Safe to use from several threads at once.
+class DeltaBaseCache{
+    public:
+        explicit DeltaBaseCache(size_t byteLimit): byteLimit(byteLimit) {}
+
+        std::shared_ptr<const RawObject> find(uint64_t offset);
+        void insert(uint64_t offset, std::shared_ptr<const RawObject> base);
+
+    private:
+        using Entry = std::pair<uint64_t, std::shared_ptr<const RawObject>>;
+
+        std::mutex mutex;
+        size_t byteLimit;
+        size_t bytes = 0;
+        // most recently used first
+        std::list<Entry> entries;
+        std::unordered_map<uint64_t, std::list<Entry>::iterator> byOffset;
+};
+
+// A pack and its index. Objects are inflated straight out of the mapping and
+// deltas are resolved against their base; bases that live outside this pack
+// (REF_DELTA) are looked up through resolveExternal. Bases found inside the
+// pack are kept in a DeltaBaseCache, so objects sharing a delta chain do not
+// each inflate the whole chain again.
+class PackFile{
+    public:
+        // depth is the number of deltas already stacked on the requested base,
+        // passed back into read() so a chain that loops through another pack
+        // is still cut off
+        using BaseResolver = std::function<RawObject(const ObjectId& id, unsigned depth)>;
+
+        // longer delta chains are rejected as corrupt; git writes at most 4095
+        static const unsigned MAX_DELTA_DEPTH = 4096;
+
+        explicit PackFile(const std::filesystem::path& packPath);
+
+        const PackIndex& index() const { return packIndex; }
+        const std::filesystem::path& packPath() const { return path; }
+        bool contains(const ObjectId& id) const { return packIndex.find(id).has_value(); }
+
+        RawObject read(const ObjectId& id, const BaseResolver& resolveExternal, unsigned depth = 0) const;
+        RawObject readAt(uint64_t offset, const BaseResolver& resolveExternal, unsigned depth = 0) const;
+        // type and size of an object without inflating it; for a delta only
+        // the start of the delta is inflated and the chain's headers walked
+        Header readHeader(const ObjectId& id, const BaseResolver& resolveExternal) const;
+        // report the object's header to onHeader, then pass its content to
+        // sink; whole entries are inflated chunk by chunk straight from the
+        // mapping, deltas are rebuilt in memory and passed in one piece
+        Header stream(const ObjectId& id,
+                      const BaseResolver& resolveExternal,
+                      const std::function<void(const Header&)>& onHeader,
+                      const std::function<void(std::string_view)>& sink) const;
+
+    private:
+        // type and size of one pack entry, the base it is a delta against
+        // (baseOffset for OFS_DELTA, baseId for REF_DELTA) and where its
+        // compressed data starts
+        struct EntryHeader {
+            int packType;
+            size_t size;
+            uint64_t baseOffset = 0;
+            ObjectId baseId{};
+            size_t dataOffset;
+        };
+
+        EntryHeader readEntryHeader(uint64_t offset) const;
+        std::shared_ptr<const RawObject> readBase(uint64_t offset,
+                                                  const BaseResolver& resolveExternal,
+                                                  unsigned depth) const;
+
+        std::filesystem::path path;
+        MappedFile file;
+        PackIndex packIndex;
+        mutable DeltaBaseCache baseCache;
+};
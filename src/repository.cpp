@@ -0,0 +1,165 @@
+#include <fstream>
+#include <stdexcept>
+
+#include "repository.h"
+#include "blob.h"
+#include "commit.h"
+
+namespace fs = std::filesystem;
+
+Repository::Repository(fs::path workTree):
+    workTreePath(std::move(workTree)),
+    gitDirPath(workTreePath / ".git"),
+    objectDatabase(gitDirPath / "objects")
+{
+}
+
+Repository Repository::init(const fs::path& workTree)
+{
+    Repository repo(workTree);
+    fs::create_directories(repo.gitDirPath / "objects");
+    fs::create_directories(repo.gitDirPath / "refs");
+
+    std::ofstream headFile(repo.gitDirPath / "HEAD");
+    if (!headFile.is_open())
+    {
+        throw std::runtime_error("Failed to create .git/HEAD file.");
+    }
+    headFile << "ref: refs/heads/main\n";
+    return repo;
+}
+
+Repository Repository::open(const fs::path& workTree)
+{
+    Repository repo(workTree);
+    if (!fs::is_directory(repo.objectDatabase.directory()))
+    {
+        throw std::runtime_error("not a git repository: " + workTree.string());
+    }
+    return repo;
+}
+
+bool Repository::hasObject(const std::string& sha) const
+{
+    return objectDatabase.hasObject(sha);
+}
+
+RawObject Repository::readObject(const std::string& sha) const
+{
+    return objectDatabase.readObject(sha);
+}
+
+std::string Repository::readBlob(const std::string& blobSha) const
+{
+    std::string content;
+    readBlobObject(content, objectDatabase, blobSha);
+    return content;
+}
+
+void Repository::streamBlob(const std::string& blobSha, const ObjectSink& sink) const
+{
+    objectDatabase.streamObject(blobSha, sink, ObjectType::blob);
+}
+
+void Repository::streamBlob(const std::string& blobSha, int fd) const
+{
+    streamBlobObject(fd, objectDatabase, blobSha);
+}
+
+std::string Repository::writeBlob(std::string_view content)
+{
+    return objectDatabase.writeObject(ObjectType::blob, content);
+}
+
+std::string Repository::hashFile(const fs::path& file)
+{
+    std::string hash;
+    createBlobObject(hash, objectDatabase, file.string());
+    return hash;
+}
+
+Tree Repository::readTree(const std::string& treeSha) const
+{
+    Tree tree;
+    readTreeObject(tree, objectDatabase, treeSha);
+    return tree;
+}
+
+std::string Repository::resolveTree(const std::string& treeish) const
+{
+    RawObject object = objectDatabase.readObject(treeish);
+    if (object.type == ObjectType::tree)
+    {
+        return treeish;
+    }
+    if (object.type == ObjectType::commit)
+    {
+        std::string treeSha;
+        std::vector<std::string> parents;
+        parseCommitObject(object.content, treeSha, parents);
+        return treeSha;
+    }
+    throw std::runtime_error("object " + treeish + " is neither a tree nor a commit");
+}
+
+std::string Repository::writeTree()
+{
+    return writeTree(workTreePath);
+}
+
+std::string Repository::writeTree(const fs::path& dir)
+{
+    std::string treeHash;
+    createTreeHash(treeHash, objectDatabase, dir);
+    return treeHash;
+}
+
+std::vector<std::string> Repository::listRefTargets() const
+{
+    std::vector<std::string> targets;
+    auto addTarget = [&targets](std::string_view text)
+    {
+        ObjectId id;
+        if (text.size() >= 40 && parseObjectId(text.substr(0, 40), id))
+        {
+            targets.push_back(objectIdToHex(id));
+        }
+    };
+
+    // symbolic refs ("ref: refs/heads/main") resolve through the refs directory
+    std::ifstream headFile(gitDirPath / "HEAD");
+    std::string line;
+    if (std::getline(headFile, line))
+    {
+        addTarget(line);
+    }
+
+    std::error_code ec;
+    for (const fs::directory_entry& refEntry : fs::recursive_directory_iterator(gitDirPath / "refs", ec))
+    {
+        if (!refEntry.is_regular_file()) continue;
+        std::ifstream refFile(refEntry.path());
+        if (std::getline(refFile, line))
+        {
+            addTarget(line);
+        }
+    }
+
+    // "<sha> <refname>" lines, plus "^<sha>" lines naming what an annotated tag points to
+    std::ifstream packedRefs(gitDirPath / "packed-refs");
+    while (std::getline(packedRefs, line))
+    {
+        if (line.starts_with("#")) continue;
+        addTarget(line.starts_with("^") ? std::string_view(line).substr(1) : std::string_view(line));
+    }
+    return targets;
+}
+
+std::string Repository::createCommit(const std::string& treeSha,
+                                     const std::string& parentSha,
+                                     const std::string& message)
+{
+    std::string commitSha;
+    ::createCommit(commitSha, objectDatabase, treeSha, parentSha, message);
+    return commitSha;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "object_database.h"
+#include "tree.h"
+
+// In-process entry point of libgitlite. A Repository is opened once and then
+// serves any number of object reads and writes without spawning the CLI;
+// every call returns its result and reports failures by throwing.
+class Repository{
+    public:
+        // create `.git` (objects, refs, HEAD) under workTree and open it
+        static Repository init(const std::filesystem::path& workTree);
+        // open an existing repository whose `.git` lives directly under workTree
+        static Repository open(const std::filesystem::path& workTree);
+
+        const std::filesystem::path& workTree() const { return workTreePath; }
+        const std::filesystem::path& gitDir() const { return gitDirPath; }
+        ObjectDatabase& objects() { return objectDatabase; }
+        const ObjectDatabase& objects() const { return objectDatabase; }
+
+        bool hasObject(const std::string& sha) const;
+        RawObject readObject(const std::string& sha) const;
+
+        std::string readBlob(const std::string& blobSha) const;
+        // bounded-memory alternatives to readBlob for arbitrarily large blobs
+        void streamBlob(const std::string& blobSha, const ObjectSink& sink) const;
+        void streamBlob(const std::string& blobSha, int fd) const;
+        std::string writeBlob(std::string_view content);
+        std::string hashFile(const std::filesystem::path& file);
+
+        Tree readTree(const std::string& treeSha) const;
+        // the tree named by a tree id, or the root tree of a commit id
+        std::string resolveTree(const std::string& treeish) const;
+        // snapshot a directory (the work tree by default) into tree objects
+        std::string writeTree();
+        std::string writeTree(const std::filesystem::path& dir);
+
+        // object ids named by HEAD, loose refs under `refs/` and `packed-refs`
+        std::vector<std::string> listRefTargets() const;
+
+        std::string createCommit(const std::string& treeSha,
+                                 const std::string& parentSha,
+                                 const std::string& message);
+
+    private:
+        Repository(std::filesystem::path workTree);
+
+        std::filesystem::path workTreePath;
+        std::filesystem::path gitDirPath;
+        ObjectDatabase objectDatabase;
+};
@@ -0,0 +1,113 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed set of worker threads pulling tasks from one queue. submit() returns
+// a future for the task's result; exceptions thrown by a task are rethrown
+// from future::get(). The destructor finishes queued tasks and joins. The
+// thread count is capped at MAX_THREADS_PER_CORE per core.
+class ThreadPool{
+    public:
+        explicit ThreadPool(unsigned threadCount = 0)
+        {
+            if (threadCount == 0)
+            {
+                threadCount = defaultThreadCount();
+            }
+            threadCount = std::min(threadCount, defaultThreadCount() * MAX_THREADS_PER_CORE);
+            workers.reserve(threadCount);
+            try
+            {
+                for (unsigned i = 0; i < threadCount; i++)
+                {
+                    workers.emplace_back([this] { workerLoop(); });
+                }
+            } catch (...)
+            {
+                // joinable threads would call std::terminate when destroyed,
+                // so the ones already started are stopped before rethrowing
+                stopAndJoin();
+                throw;
+            }
+        }
+
+        ~ThreadPool()
+        {
+            stopAndJoin();
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        template <typename F>
+        std::future<std::invoke_result_t<F>> submit(F task)
+        {
+            using Result = std::invoke_result_t<F>;
+            auto packaged = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+            std::future<Result> result = packaged->get_future();
+            {
+                std::lock_guard lock(mutex);
+                tasks.push([packaged] { (*packaged)(); });
+            }
+            wakeUp.notify_one();
+            return result;
+        }
+
+        size_t size() const { return workers.size(); }
+
+        static unsigned defaultThreadCount()
+        {
+            unsigned count = std::thread::hardware_concurrency();
+            return count == 0 ? 1 : count;
+        }
+
+        // more workers than this per core only add scheduling overhead
+        static constexpr unsigned MAX_THREADS_PER_CORE = 4;
+
+    private:
+        void stopAndJoin()
+        {
+            {
+                std::lock_guard lock(mutex);
+                stopping = true;
+            }
+            wakeUp.notify_all();
+            for (std::thread& worker : workers)
+            {
+                worker.join();
+            }
+        }
+
+        void workerLoop()
+        {
+            while (true)
+            {
+                std::function<void()> task;
+                {
+                    std::unique_lock lock(mutex);
+                    wakeUp.wait(lock, [this] { return stopping || !tasks.empty(); });
+                    if (tasks.empty())
+                    {
+                        return;
+                    }
+                    task = std::move(tasks.front());
+                    tasks.pop();
+                }
+                task();
+            }
+        }
+
+        std::vector<std::thread> workers;
+        std::queue<std::function<void()>> tasks;
+        std::mutex mutex;
+        std::condition_variable wakeUp;
+        bool stopping = false;
+};
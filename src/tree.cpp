@@ -1,6 +1,7 @@
 #include <filesystem>
 #include <fstream>
 #include <algorithm>
+#include <unordered_map>
 
 #include "blob.h"
 #include "tree.h"
@@ -19,8 +20,7 @@ void Tree::parseTree(const std::string& content)
         size_t spacePos = content.find(' ',pos);
         if(spacePos == std::string::npos) 
         {
-            std::cout << "space not found";
-            break;
+            throw std::runtime_error("malformed tree entry: space not found");
         }
         std::string mode = content.substr(pos,spacePos-pos);
         pos= spacePos + 1;
@@ -29,13 +29,16 @@ void Tree::parseTree(const std::string& content)
         size_t nullPos = content.find('\0', pos);
         if(nullPos == std::string::npos) 
         {
-            std::cout << "null byte not found"; 
-            break;
+            throw std::runtime_error("malformed tree entry: null byte not found");
         }
         std::string name = content.substr(pos,nullPos-pos);
         pos= nullPos + 1;
 
         // 20 bit SHA-1 binary hash
+        if (l - pos < 20)
+        {
+            throw std::runtime_error("malformed tree entry: truncated hash");
+        }
         std::string byteHash = content.substr(pos,20);
         pos += 20;
         std::string hexHash;
@@ -49,6 +52,11 @@ void Tree::parseTree(const std::string& content)
         {
             entry.type = "tree";
         }
+        else if (mode == "160000")
+        {
+            // submodule: the hash names a commit in another repository
+            entry.type = "commit";
+        }
         else if (mode == "100644")
         {
             entry.type = "blob";
@@ -62,18 +70,16 @@ void Tree::parseTree(const std::string& content)
     }
 }
 
-void createTreeHash(std::string& treeHash, fs::path dir_path)
+void createTreeHash(std::string& treeHash, ObjectDatabase& objects, const fs::path& dir_path)
 {
     if (!fs::exists(dir_path))
     {
-        std::cerr << "directory not found!";
-        return;
+        throw std::runtime_error("directory not found: " + dir_path.string());
     }
 
     if (!fs::is_directory(dir_path))
     {
-        std::cerr << "path is not a directory " << dir_path;
-        return;
+        throw std::runtime_error("path is not a directory " + dir_path.string());
     }
     Tree tree;
     for (fs::directory_entry dir_entry: fs::directory_iterator(dir_path))
@@ -84,9 +90,21 @@ void createTreeHash(std::string& treeHash, fs::path dir_path)
         TreeEntries treeEntry;
         if (dir_entry.is_directory() && entry_pathStr == ".git") continue;
 
-        if (fs::is_regular_file(dir_entry))
+        if (dir_entry.is_symlink())
         {
-            createBlobObject(outputHash, entry_path.string());
+            // the blob holds the link target itself; the link is never followed
+            outputHash = objects.writeObject(ObjectType::blob, fs::read_symlink(entry_path).string());
+            std::string binaryHash;
+            hexToByteHash(binaryHash, outputHash);
+            // use mode = 120000
+            treeEntry.mode = "120000";
+            treeEntry.name = entry_pathStr;
+            treeEntry.hash = binaryHash;
+
+        }
+        else if (fs::is_regular_file(dir_entry))
+        {
+            createBlobObject(outputHash, objects, entry_path.string());
             std::string binaryHash;
             hexToByteHash(binaryHash, outputHash);
 
@@ -104,22 +122,11 @@ void createTreeHash(std::string& treeHash, fs::path dir_path)
             treeEntry.name = entry_pathStr;
             treeEntry.hash = binaryHash;
         }
-        else if (fs::is_symlink(dir_entry))
-        {
-            createBlobObject(outputHash, entry_path.string());
-            std::string binaryHash;
-            hexToByteHash(binaryHash, outputHash);
-            // use mode = 120000
-            treeEntry.mode = "120000";
-            treeEntry.name = entry_pathStr;
-            treeEntry.hash = binaryHash;
-
-        }
         else if (fs::is_directory(dir_entry))
         {
             // go recursively here
             std::string subdirHash;
-            createTreeHash(subdirHash, entry_path.string());
+            createTreeHash(subdirHash, objects, entry_path);
             std::string binaryHash;
             hexToByteHash(binaryHash, subdirHash);
 
@@ -130,7 +137,7 @@ void createTreeHash(std::string& treeHash, fs::path dir_path)
         }
         else 
         {
-            std::cerr << "skipping undetected object at : " << dir_entry;
+            // sockets, fifos and devices cannot be stored; like git, leave them out
             continue;
         }
 
@@ -147,86 +154,164 @@ void createTreeHash(std::string& treeHash, fs::path dir_path)
             return a.name < b.name;
         });
     
-    std::string treeContent;
-    for (TreeEntries treeEntry:tree.entries)
+    // each entry is "<mode> <name>\0<20 byte hash>", passed as segments
+    // pointing into the entries instead of being copied into one buffer
+    std::vector<std::string_view> treeContent;
+    treeContent.reserve(tree.entries.size() * 5);
+    for (const TreeEntries& treeEntry:tree.entries)
     {
-        treeContent.append(treeEntry.mode);
-        treeContent.push_back(' ');
-        treeContent.append(treeEntry.name);
-        treeContent.push_back('\0');
-        treeContent.insert(treeContent.end(), treeEntry.hash.begin(), treeEntry.hash.end());
-    }
-    std::string treeHeader = "tree " + std::to_string(treeContent.size());
-    treeHeader.push_back('\0');
-    std::string treeData;
-    treeData.reserve(treeHeader.size() + treeContent.size());
-    treeData.append(treeHeader);
-    treeData.append(treeContent);
-
-    // produce the SHA-1 hash from the content of the tree object 
-    getSHA1(treeHash, treeData);
-
-    // compress the data 
-    uLong uncompressedSize = treeData.size();
-    uLong compressedSize = compressBound(uncompressedSize);
-    std::vector<Bytef> compressed(compressedSize);
-
-    zlibCompression(compressed,compressedSize,uncompressedSize, treeData);
-
-    // create files and folders and write the content 
-    std::string dirNamePart = treeHash.substr(0,2);
-    std::string fileNamePart = treeHash.substr(2);
-    fs::path folderPath(".git/objects/" + dirNamePart);
-    if (!fs::create_directories(folderPath))
-    {
-        std::cerr << "failed to create directory" << folderPath.string();
-        return;
-    }
-    std::string fileName(folderPath.string() + "/" + fileNamePart);
-    std::ofstream file(fileName, std::ios::binary);
-    if (!file.is_open())
-    {
-        std::cerr << "failed to create or open file " << fileName;
-        return;
+        treeContent.push_back(treeEntry.mode);
+        treeContent.push_back(std::string_view(" ", 1));
+        treeContent.push_back(treeEntry.name);
+        treeContent.push_back(std::string_view("\0", 1));
+        treeContent.push_back(treeEntry.hash);
     }
 
-    file.write(reinterpret_cast < const char*>(compressed.data()),  compressed.size());
-    file.close();
-    // std::cout << "size " << compressed.size() << " ";
+    // hash, compress and store "tree <size>\0<content>"
+    treeHash = objects.writeObject(ObjectType::tree, std::move(treeContent));
+}
 
+void readTreeObject(Tree& tree, const ObjectDatabase& objects, const std::string& treeSha)
+{
+    RawObject treeObject = objects.readObject(treeSha);
+    if (treeObject.type != ObjectType::tree)
+    {
+        throw std::runtime_error("object " + treeSha + " is not a tree");
+    }
+    tree.parseTree(treeObject.content);
 }
 
-void writeTreeObject(std::string& treeHash)
+void listTreeFiles(std::vector<TreeFile>& files,
+                   const ObjectDatabase& objects,
+                   const std::string& treeSha,
+                   const std::string& prefix)
 {
-    fs::path current_path(".");
-    createTreeHash(treeHash, current_path);
+    Tree tree;
+    readTreeObject(tree, objects, treeSha);
+    for (TreeEntries& entry : tree.entries)
+    {
+        std::string path = prefix + entry.name;
+        if (entry.type == "tree")
+        {
+            listTreeFiles(files, objects, entry.hash, path + "/");
+        }
+        else if (entry.type == "blob")
+        {
+            files.push_back(TreeFile{std::move(path), std::move(entry.mode), std::move(entry.hash)});
+        }
+    }
 }
 
-void readTreeObject(const std::string& treeSha)
+void diffTreePaths(std::vector<std::string>& paths,
+                   const ObjectDatabase& objects,
+                   const std::string& oldTreeSha,
+                   const std::string& newTreeSha,
+                   const std::string& prefix)
 {
-    GitObject treeObject(treeSha);
-    if (treeObject.fileName.length() < 2)
+    if (oldTreeSha == newTreeSha)
     {
-        throw std::runtime_error("git object name must be at least 2 characters long!");
+        return;
     }
-    std::string decompressed;
-    zlibDecompression(decompressed, treeObject);
-    std::string_view decompressedView(decompressed);
+    Tree oldTree;
+    Tree newTree;
+    if (!oldTreeSha.empty()) readTreeObject(oldTree, objects, oldTreeSha);
+    if (!newTreeSha.empty()) readTreeObject(newTree, objects, newTreeSha);
 
-    size_t nullPos = decompressedView.find('\0');
-    if (nullPos == std::string::npos)
+    std::unordered_map<std::string_view, const TreeEntries*> oldEntries;
+    for (const TreeEntries& entry : oldTree.entries)
     {
-        throw std::runtime_error("Missing null pointer between header and content");
+        oldEntries.emplace(entry.name, &entry);
     }
-    treeObject.content = decompressedView.substr(nullPos+1);
-    std::string_view header = decompressedView.substr(0,nullPos);
-    Tree tree;
-    tree.parseTree(treeObject.content);
 
-    // console log 
+    // a side that is not a tree contributes "no tree" to the recursion
+    auto subtree = [](const TreeEntries* entry)
+    {
+        return entry && entry->type == "tree" ? entry->hash : std::string();
+    };
+    auto compare = [&](const TreeEntries* before, const TreeEntries* after)
+    {
+        const std::string& name = before ? before->name : after->name;
+        if (before && after && before->hash == after->hash && before->mode == after->mode)
+        {
+            return;
+        }
+        std::string path = prefix + name;
+        paths.push_back(path);
+        if (subtree(before) != subtree(after))
+        {
+            diffTreePaths(paths, objects, subtree(before), subtree(after), path + "/");
+        }
+    };
 
-    for (TreeEntries& entries:tree.entries)
+    for (const TreeEntries& entry : newTree.entries)
     {
-        std::cout << entries.name << "\n";
+        auto before = oldEntries.find(entry.name);
+        if (before == oldEntries.end())
+        {
+            compare(nullptr, &entry);
+        }
+        else
+        {
+            compare(before->second, &entry);
+            oldEntries.erase(before);
+        }
     }
-}
\ No newline at end of file
+    for (const TreeEntries& entry : oldTree.entries)
+    {
+        if (oldEntries.contains(entry.name))
+        {
+            compare(&entry, nullptr);
+        }
+    }
+}
+
+bool treePathChanged(const ObjectDatabase& objects,
+                     const std::string& oldTreeSha,
+                     const std::string& newTreeSha,
+                     std::string_view path)
+{
+    std::string oldSha = oldTreeSha;
+    std::string newSha = newTreeSha;
+    std::string oldMode = "40000";
+    std::string newMode = "40000";
+
+    // descend one component at a time; the hashes at the end of the path
+    // tell whether anything below it changed
+    while (!path.empty())
+    {
+        if (oldSha == newSha && oldMode == newMode)
+        {
+            return false;
+        }
+        size_t slash = path.find('/');
+        std::string_view component = path.substr(0, slash);
+        path = slash == std::string_view::npos ? std::string_view() : path.substr(slash + 1);
+
+        auto lookup = [&](std::string& sha, std::string& mode)
+        {
+            if (sha.empty() || mode != "40000")
+            {
+                // the parent is missing or is not a directory
+                sha.clear();
+                mode.clear();
+                return;
+            }
+            Tree tree;
+            readTreeObject(tree, objects, sha);
+            sha.clear();
+            mode.clear();
+            for (TreeEntries& entry : tree.entries)
+            {
+                if (entry.name == component)
+                {
+                    sha = std::move(entry.hash);
+                    mode = std::move(entry.mode);
+                    return;
+                }
+            }
+        };
+        lookup(oldSha, oldMode);
+        lookup(newSha, newMode);
+    }
+    return oldSha != newSha || oldMode != newMode;
+}
@@ -1,7 +1,11 @@
 #pragma once
+#include <filesystem>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "object_database.h"
+
 struct TreeEntries{
     std::string mode;
     std::string name;
@@ -16,6 +20,31 @@ class Tree{
         void parseTree(const std::string& content);
 };
 
-void readTreeObject(const std::string& treeSha);
-void writeTreeObject(std::string& treehash);
-void readTreeObject(const std::string& treeSha);
\ No newline at end of file
+// a blob reachable from a root tree, with its path relative to that root
+struct TreeFile{
+    std::string path;
+    std::string mode;
+    std::string hash;
+};
+
+void createTreeHash(std::string& treeHash, ObjectDatabase& objects, const std::filesystem::path& dir_path);
+void readTreeObject(Tree& tree, const ObjectDatabase& objects, const std::string& treeSha);
+// append every blob below treeSha (recursing into subtrees, skipping
+// submodules) in Git's path order
+void listTreeFiles(std::vector<TreeFile>& files,
+                   const ObjectDatabase& objects,
+                   const std::string& treeSha,
+                   const std::string& prefix = "");
+// append every path that differs between two trees (either sha may be empty
+// for "no tree"), including each directory that contains a change
+void diffTreePaths(std::vector<std::string>& paths,
+                   const ObjectDatabase& objects,
+                   const std::string& oldTreeSha,
+                   const std::string& newTreeSha,
+                   const std::string& prefix = "");
+// whether the file or directory at path differs between two trees; only the
+// trees along path are read
+bool treePathChanged(const ObjectDatabase& objects,
+                     const std::string& oldTreeSha,
+                     const std::string& newTreeSha,
+                     std::string_view path);